@@ -101,6 +101,14 @@ class avl_tree
      */
     const V& find(const K& key) const;
 
+    /**
+     * Calls func(key, value) for every node in the tree, in an in-order
+     * traversal.
+     * @param func The function to call
+     */
+    template <class Func>
+    void for_each(Func func) const;
+
     /**
      * Prints the avl_tree to a stream (default stdout).
      * @param out The stream to print to
@@ -132,6 +140,14 @@ class avl_tree
      */
     const V& find(const node* node, const K& key) const;
 
+    /**
+     * Private helper function for the public for_each function.
+     * @param subtree The current node in the recursion
+     * @param func The function to call
+     */
+    template <class Func>
+    void for_each(const node* subtree, Func& func) const;
+
     /**
      * Checks if a subtree needs rebalanced, and invokes the correct
      * helper functions to fix the imbalance, if one exists.
@@ -31,6 +31,24 @@ const V& avl_tree<K, V>::find(const node* subtree, const K& key) const {
     }
 }
 
+template <class K, class V>
+template <class Func>
+void avl_tree<K, V>::for_each(Func func) const
+{
+    for_each(root_.get(), func);
+}
+
+template <class K, class V>
+template <class Func>
+void avl_tree<K, V>::for_each(const node* subtree, Func& func) const
+{
+    if (!subtree)
+        return;
+    for_each(subtree->left.get(), func);
+    func(subtree->key, subtree->value);
+    for_each(subtree->right.get(), func);
+}
+
 template <class K, class V>
 void avl_tree<K, V>::rotate_left(std::unique_ptr<node>& t)
 {
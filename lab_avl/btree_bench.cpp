@@ -0,0 +1,187 @@
+/**
+ * @file btree_bench.cpp
+ * Benchmark of btree_map against avl_tree.
+ *
+ * Usage: btree_bench [millions of keys]...
+ *
+ * For each number of keys (1, 10 and 100 million by default) and each
+ * map, inserts the keys in random order, finds every one of them in
+ * another random order and scans the whole map in order, reporting the
+ * time per key of each step and the peak resident memory. Each
+ * measurement runs in its own child process, so that the peak memory
+ * belongs to that map alone, and a map too large for the machine only
+ * fails its own row.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "avl_tree.h"
+#include "btree_map.h"
+
+namespace
+{
+/**
+ * Timings of one run over a map, in nanoseconds per key.
+ */
+struct result
+{
+    double insert_ns = 0;
+    double find_ns = 0;
+    double scan_ns = 0;
+};
+
+double ns_per_key(std::chrono::steady_clock::time_point start, size_t keys)
+{
+    return std::chrono::duration<double, std::nano>(
+               std::chrono::steady_clock::now() - start).count()
+           / keys;
+}
+
+/**
+ * Inserts, finds and scans keys with a map, checking what it finds.
+ *
+ * @param map An empty map.
+ * @param keys The keys to insert, in insertion order; each key's value
+ * is the key plus one.
+ * @param lookups The same keys, in lookup order.
+ */
+template <class Map>
+result run(Map& map, const std::vector<uint32_t>& keys,
+           const std::vector<uint32_t>& lookups)
+{
+    result r;
+    auto start = std::chrono::steady_clock::now();
+    for (auto key : keys)
+        map.insert(key, key + 1);
+    r.insert_ns = ns_per_key(start, keys.size());
+
+    uint64_t sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (auto key : lookups)
+        sum += map.find(key);
+    r.find_ns = ns_per_key(start, keys.size());
+    uint64_t n = keys.size();
+    if (sum != n * (n + 1) / 2)
+        throw std::runtime_error{"found the wrong values"};
+
+    uint64_t expected = 0;
+    bool ordered = true;
+    start = std::chrono::steady_clock::now();
+    map.for_each([&](uint32_t key, uint32_t value)
+    {
+        ordered &= key == expected && value == key + 1;
+        ++expected;
+    });
+    r.scan_ns = ns_per_key(start, keys.size());
+    if (!ordered || expected != n)
+        throw std::runtime_error{"scan out of order"};
+    return r;
+}
+
+/**
+ * Measures one map on keys in a child process and prints a row of the
+ * report.
+ */
+template <class Map>
+void measure(const std::string& name, const std::vector<uint32_t>& keys,
+             const std::vector<uint32_t>& lookups)
+{
+    std::fflush(stdout);
+    auto pid = ::fork();
+    if (pid < 0)
+        throw std::runtime_error{"fork failed"};
+    if (pid == 0)
+    {
+        int status = 0;
+        try
+        {
+            Map map;
+            auto r = run(map, keys, lookups);
+            std::printf("%8.0fM %-6s %10.1f %10.1f %10.1f",
+                        keys.size() / 1e6, name.c_str(), r.insert_ns,
+                        r.find_ns, r.scan_ns);
+        }
+        catch (const std::exception& e)
+        {
+            std::printf("%8.0fM %-6s failed: %s", keys.size() / 1e6,
+                        name.c_str(), e.what());
+            status = 1;
+        }
+        std::fflush(stdout);
+        ::_exit(status);
+    }
+
+    int status;
+    struct rusage usage;
+    if (::wait4(pid, &status, 0, &usage) < 0)
+        throw std::runtime_error{"wait failed"};
+    if (WIFSIGNALED(status))
+        std::printf("%8.0fM %-6s killed by signal %d", keys.size() / 1e6,
+                    name.c_str(), WTERMSIG(status));
+    // ru_maxrss is in kilobytes
+    std::printf(" %9.1f\n", usage.ru_maxrss / 1024.0);
+}
+
+/**
+ * avl_tree names every rotation on its output stream; send them
+ * nowhere so that they cost as little as possible.
+ */
+class quiet_avl_tree : public avl_tree<uint32_t, uint32_t>
+{
+  public:
+    quiet_avl_tree() : null_out_{nullptr}
+    {
+        setOutput(null_out_);
+    }
+
+  private:
+    std::ostream null_out_;
+};
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<size_t> millions;
+    for (int i = 1; i < argc; ++i)
+        millions.push_back(std::strtoul(argv[i], nullptr, 10));
+    if (millions.empty())
+        millions = {1, 10, 100};
+    if (std::count(millions.begin(), millions.end(), 0)
+        || std::any_of(millions.begin(), millions.end(),
+                       [](size_t m) { return m > 4000; }))
+    {
+        std::fprintf(stderr, "usage: %s [millions of keys]...\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%9s %-6s %10s %10s %10s %9s\n", "keys", "map",
+                "insert ns", "find ns", "scan ns", "peak MiB");
+    for (auto m : millions)
+    {
+        std::mt19937_64 rng{225};
+        std::vector<uint32_t> keys(m * 1000000);
+        std::iota(keys.begin(), keys.end(), 0);
+        std::shuffle(keys.begin(), keys.end(), rng);
+        auto lookups = keys;
+        std::shuffle(lookups.begin(), lookups.end(), rng);
+
+        measure<btree_map<uint32_t, uint32_t>>("btree", keys, lookups);
+        measure<quiet_avl_tree>("avl", keys, lookups);
+    }
+    return 0;
+}
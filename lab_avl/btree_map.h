@@ -0,0 +1,164 @@
+/**
+ * @file btree_map.h
+ * Declaration of the btree_map class, a cache-friendly ordered map with
+ * the same insert/find interface as avl_tree.
+ */
+
+#ifndef BTREE_MAP_H_
+#define BTREE_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * The btree_map class is a B+-tree: every key/value pair lives in a leaf,
+ * and the interior levels only hold separator keys. Nodes hold many keys
+ * in contiguous arrays sized to a few cache lines, and all nodes of a kind
+ * live in a single std::vector addressed by 32-bit indices, so a lookup
+ * touches O(log_B n) small, dense blocks of memory instead of one heap
+ * allocation per key like avl_tree.
+ *
+ * K and V must be default constructible and copy/move assignable. Inserting
+ * a key that is already present replaces its value.
+ */
+template <class K, class V>
+class btree_map
+{
+  private:
+    /**
+     * Number of bytes of keys each node should hold. 256 bytes is four
+     * cache lines: large enough to keep the tree shallow, small enough
+     * that a search within a node stays in L1.
+     */
+    static constexpr std::size_t node_bytes = 256;
+
+    /**
+     * Maximum number of keys in a node before it is split.
+     */
+    static constexpr std::size_t order =
+        node_bytes / sizeof(K) < 4 ? 4 : node_bytes / sizeof(K);
+
+    /**
+     * Index standing for "no leaf" at the end of the leaf chain.
+     */
+    static constexpr uint32_t no_leaf = UINT32_MAX;
+
+    /**
+     * A leaf holds the actual key/value pairs, sorted by key. Keys and
+     * values are kept in separate arrays so that searching only pulls
+     * keys into the cache. Arrays have one spare slot so an insert can
+     * overflow a node before it is split. Leaves are chained left to
+     * right through next, so an in-order scan never climbs the tree.
+     */
+    struct leaf
+    {
+        uint32_t count = 0;
+        uint32_t next = no_leaf;
+        K keys[order + 1];
+        V values[order + 1];
+    };
+
+    /**
+     * An interior node holds count separator keys and count + 1 child
+     * indices. Children are leaves if the node is on the lowest interior
+     * level, and interior nodes otherwise.
+     */
+    struct inner
+    {
+        uint32_t count = 0;
+        K keys[order + 1];
+        uint32_t children[order + 2];
+    };
+
+    /**
+     * Result of inserting into a subtree: whether the subtree's root was
+     * split, and if so the separator key and index of the new right node.
+     */
+    struct split_result
+    {
+        bool split = false;
+        K key;
+        uint32_t right = 0;
+    };
+
+  public:
+    /**
+     * Constructor to create an empty map.
+     */
+    btree_map();
+
+    /**
+     * Swaps the current btree_map with the parameter.
+     * @param other The map to swap with
+     */
+    void swap(btree_map& other);
+
+    /**
+     * Inserts into the btree_map.
+     * @param key The key to insert
+     * @param value The value for the key to insert
+     */
+    void insert(K key, V value);
+
+    /**
+     * Finds an element in the btree_map.
+     * @param key The element to search for
+     * @return the value stored for that key
+     */
+    const V& find(const K& key) const;
+
+    /**
+     * Calls func(key, value) for every pair in the map, in increasing
+     * key order.
+     * @param func The function to call
+     */
+    template <class Func>
+    void for_each(Func func) const;
+
+    /**
+     * @return the number of keys stored in the map
+     */
+    std::size_t size() const;
+
+    /**
+     * @return whether the map is empty
+     */
+    bool empty() const;
+
+  private:
+    /// Storage for every leaf in the tree
+    std::vector<leaf> leaves_;
+    /// Storage for every interior node in the tree
+    std::vector<inner> inners_;
+    /// Index of the root (a leaf index if height_ is 0)
+    uint32_t root_;
+    /// Number of interior levels above the leaves
+    uint32_t height_;
+    /// Number of keys stored
+    std::size_t size_;
+
+    /**
+     * Private helper for the public insert function.
+     * @param idx The index of the current subroot
+     * @param level The level of the subroot (0 for leaves)
+     * @param key The key to insert
+     * @param value The value for the key to insert
+     * @return whether the subroot split and how
+     */
+    split_result insert(uint32_t idx, uint32_t level, K& key, V& value);
+
+    /**
+     * Inserts into a leaf, splitting it if it overflows.
+     */
+    split_result insert_leaf(uint32_t idx, K& key, V& value);
+
+    /**
+     * Splits an overflowing interior node in two.
+     */
+    split_result split_inner(uint32_t idx);
+};
+
+#include "btree_map.tcc"
+#endif
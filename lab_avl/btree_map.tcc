@@ -0,0 +1,200 @@
+/**
+ * @file btree_map.tcc
+ * Definitions of the btree_map functions.
+ */
+
+#include <algorithm>
+#include <utility>
+
+#include "btree_map.h"
+
+template <class K, class V>
+btree_map<K, V>::btree_map()
+    : root_{0}, height_{0}, size_{0}
+{
+    // nothing
+}
+
+template <class K, class V>
+void btree_map<K, V>::swap(btree_map& other)
+{
+    std::swap(leaves_, other.leaves_);
+    std::swap(inners_, other.inners_);
+    std::swap(root_, other.root_);
+    std::swap(height_, other.height_);
+    std::swap(size_, other.size_);
+}
+
+template <class K, class V>
+std::size_t btree_map<K, V>::size() const
+{
+    return size_;
+}
+
+template <class K, class V>
+bool btree_map<K, V>::empty() const
+{
+    return size_ == 0;
+}
+
+template <class K, class V>
+const V& btree_map<K, V>::find(const K& key) const
+{
+    if (leaves_.empty())
+        throw std::out_of_range{"invalid key"};
+
+    auto idx = root_;
+    for (auto level = height_; level > 0; --level)
+    {
+        const auto& n = inners_[idx];
+        auto pos = std::upper_bound(n.keys, n.keys + n.count, key) - n.keys;
+        idx = n.children[pos];
+    }
+
+    const auto& l = leaves_[idx];
+    auto pos = std::lower_bound(l.keys, l.keys + l.count, key) - l.keys;
+    if (pos == l.count || key < l.keys[pos])
+        throw std::out_of_range{"invalid key"};
+    return l.values[pos];
+}
+
+template <class K, class V>
+template <class Func>
+void btree_map<K, V>::for_each(Func func) const
+{
+    if (leaves_.empty())
+        return;
+
+    // leaves only ever split to the right, so the first one created
+    // stays the leftmost
+    for (auto idx = uint32_t{0}; idx != no_leaf; idx = leaves_[idx].next)
+    {
+        const auto& l = leaves_[idx];
+        for (uint32_t i = 0; i < l.count; ++i)
+            func(l.keys[i], l.values[i]);
+    }
+}
+
+template <class K, class V>
+void btree_map<K, V>::insert(K key, V value)
+{
+    if (leaves_.empty())
+    {
+        leaves_.emplace_back();
+        root_ = 0;
+        height_ = 0;
+    }
+
+    auto res = insert(root_, height_, key, value);
+    if (!res.split)
+        return;
+
+    // the root split: grow the tree by one level
+    inners_.emplace_back();
+    auto& n = inners_.back();
+    n.count = 1;
+    n.keys[0] = std::move(res.key);
+    n.children[0] = root_;
+    n.children[1] = res.right;
+    root_ = static_cast<uint32_t>(inners_.size() - 1);
+    ++height_;
+}
+
+template <class K, class V>
+auto btree_map<K, V>::insert(uint32_t idx, uint32_t level, K& key, V& value)
+    -> split_result
+{
+    if (level == 0)
+        return insert_leaf(idx, key, value);
+
+    uint32_t pos;
+    {
+        const auto& n = inners_[idx];
+        pos = std::upper_bound(n.keys, n.keys + n.count, key) - n.keys;
+    }
+
+    auto res = insert(inners_[idx].children[pos], level - 1, key, value);
+    if (!res.split)
+        return res;
+
+    // recursion may have grown inners_, so look the node up again
+    auto& n = inners_[idx];
+    std::move_backward(n.keys + pos, n.keys + n.count, n.keys + n.count + 1);
+    std::move_backward(n.children + pos + 1, n.children + n.count + 1,
+                       n.children + n.count + 2);
+    n.keys[pos] = std::move(res.key);
+    n.children[pos + 1] = res.right;
+    ++n.count;
+
+    if (n.count <= order)
+        return {};
+    return split_inner(idx);
+}
+
+template <class K, class V>
+auto btree_map<K, V>::insert_leaf(uint32_t idx, K& key, V& value)
+    -> split_result
+{
+    {
+        auto& l = leaves_[idx];
+        auto pos = std::lower_bound(l.keys, l.keys + l.count, key) - l.keys;
+        if (pos < l.count && !(key < l.keys[pos]))
+        {
+            l.values[pos] = std::move(value);
+            return {};
+        }
+
+        std::move_backward(l.keys + pos, l.keys + l.count,
+                           l.keys + l.count + 1);
+        std::move_backward(l.values + pos, l.values + l.count,
+                           l.values + l.count + 1);
+        l.keys[pos] = std::move(key);
+        l.values[pos] = std::move(value);
+        ++l.count;
+        ++size_;
+
+        if (l.count <= order)
+            return {};
+    }
+
+    leaves_.emplace_back();
+    auto right_idx = static_cast<uint32_t>(leaves_.size() - 1);
+    auto& l = leaves_[idx];
+    auto& right = leaves_[right_idx];
+
+    auto mid = l.count / 2;
+    right.count = l.count - mid;
+    std::move(l.keys + mid, l.keys + l.count, right.keys);
+    std::move(l.values + mid, l.values + l.count, right.values);
+    l.count = mid;
+    right.next = l.next;
+    l.next = right_idx;
+
+    split_result res;
+    res.split = true;
+    res.key = right.keys[0];
+    res.right = right_idx;
+    return res;
+}
+
+template <class K, class V>
+auto btree_map<K, V>::split_inner(uint32_t idx) -> split_result
+{
+    inners_.emplace_back();
+    auto right_idx = static_cast<uint32_t>(inners_.size() - 1);
+    auto& n = inners_[idx];
+    auto& right = inners_[right_idx];
+
+    // keys[mid] moves up to the parent; everything after it goes right
+    auto mid = n.count / 2;
+    right.count = n.count - mid - 1;
+    std::move(n.keys + mid + 1, n.keys + n.count, right.keys);
+    std::copy(n.children + mid + 1, n.children + n.count + 1, right.children);
+
+    split_result res;
+    res.split = true;
+    res.key = std::move(n.keys[mid]);
+    res.right = right_idx;
+    n.count = mid;
+    return res;
+}
@@ -0,0 +1,146 @@
+/**
+ * @file compact_avl_tree.h
+ * Declaration of the compact_avl_tree class, an avl_tree variant with a
+ * small node layout for large trees of small keys.
+ */
+
+#ifndef COMPACT_AVLTREE_H_
+#define COMPACT_AVLTREE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * The compact_avl_tree class is an AVL tree whose nodes live in one
+ * contiguous std::vector. Children are 32-bit indices into that vector and
+ * the height is a single byte, so each node costs 9 bytes (plus padding)
+ * on top of its key and value, instead of the 24 that avl_tree's two
+ * unique_ptrs and int64_t height take. Nodes inserted together also end up
+ * next to each other in memory.
+ *
+ * The tree holds at most 2^32 - 1 nodes; an AVL tree of that size is less
+ * than 47 levels tall, so the height always fits in an int8_t.
+ */
+template <class K, class V>
+class compact_avl_tree
+{
+  private:
+    /// Index used in place of a null child pointer
+    static constexpr uint32_t nil = std::numeric_limits<uint32_t>::max();
+
+    /**
+     * Represents a tree node; that is, an element in a compact_avl_tree.
+     * It has a data element and the indices of its left and right children.
+     */
+    struct node
+    {
+        K key;
+        V value;
+        uint32_t left;
+        uint32_t right;
+        int8_t height;
+
+        /**
+         * node element constructor; sets children to nil.
+         * @param k The object to use as a key
+         * @param v The templated data element that the constructed
+         *  node will hold.
+         */
+        node(K k, V v)
+            : key{std::move(k)}, value{std::move(v)}, left{nil}, right{nil},
+              height{0}
+        {
+            // nothing
+        }
+    };
+
+  public:
+    /**
+     * Constructor to create an empty tree.
+     */
+    compact_avl_tree();
+
+    /**
+     * Swaps the current compact_avl_tree with the parameter.
+     * @param other The tree to swap with
+     */
+    void swap(compact_avl_tree& other);
+
+    /**
+     * Inserts into the compact_avl_tree.
+     * @param key The key to insert
+     * @param value The value for the key to insert
+     */
+    void insert(K key, V value);
+
+    /**
+     * Finds an element in the AVL tree.
+     * @param key The element to search for
+     * @return the value stored for that key
+     */
+    const V& find(const K& key) const;
+
+    /**
+     * @return the number of nodes in the tree
+     */
+    std::size_t size() const;
+
+    /**
+     * Reserves space for the given number of nodes, so that building a
+     * tree of known size never reallocates.
+     * @param count The number of nodes to reserve space for
+     */
+    void reserve(std::size_t count);
+
+  private:
+    /// Storage for every node in the tree
+    std::vector<node> nodes_;
+    /// Index of the root, or nil if the tree is empty
+    uint32_t root_;
+
+    /**
+     * Private helper function for the public insert function.
+     * @param subtree The index of the current node in the recursion
+     * @param key The key to insert
+     * @param value The value for the key to insert
+     * @return the index of the subtree's root after inserting
+     */
+    uint32_t insert(uint32_t subtree, K& key, V& value);
+
+    /**
+     * Checks if a subtree needs rebalanced, and invokes the correct
+     * rotations to fix the imbalance, if one exists.
+     * @return the index of the subtree's new root
+     */
+    uint32_t rebalance(uint32_t subroot);
+
+    /**
+     * Rotates the tree right (there is an imbalance on the left side).
+     * @return the index of the subtree's new root
+     */
+    uint32_t rotate_right(uint32_t t);
+
+    /**
+     * Rotates the tree left (there is an imbalance on the right side).
+     * @return the index of the subtree's new root
+     */
+    uint32_t rotate_left(uint32_t t);
+
+    /**
+     * Recomputes a node's height from its children.
+     */
+    void update_height(uint32_t idx);
+
+    /**
+     * @param idx The index of the node's height to check
+     * @return the height of the node if it's not nil or -1 if it is nil
+     */
+    int heightOrNeg1(uint32_t idx) const;
+};
+
+#include "compact_avl_tree.tcc"
+#endif
@@ -0,0 +1,141 @@
+/**
+ * @file compact_avl_tree.tcc
+ * Definitions of the compact_avl_tree functions.
+ */
+
+#include <algorithm>
+#include <utility>
+
+#include "compact_avl_tree.h"
+
+template <class K, class V>
+compact_avl_tree<K, V>::compact_avl_tree()
+    : root_{nil}
+{
+    // nothing
+}
+
+template <class K, class V>
+void compact_avl_tree<K, V>::swap(compact_avl_tree& other)
+{
+    std::swap(nodes_, other.nodes_);
+    std::swap(root_, other.root_);
+}
+
+template <class K, class V>
+std::size_t compact_avl_tree<K, V>::size() const
+{
+    return nodes_.size();
+}
+
+template <class K, class V>
+void compact_avl_tree<K, V>::reserve(std::size_t count)
+{
+    nodes_.reserve(count);
+}
+
+template <class K, class V>
+const V& compact_avl_tree<K, V>::find(const K& key) const
+{
+    auto idx = root_;
+    while (idx != nil)
+    {
+        const auto& n = nodes_[idx];
+        if (key == n.key)
+            return n.value;
+        idx = key < n.key ? n.left : n.right;
+    }
+    throw std::out_of_range{"invalid key"};
+}
+
+template <class K, class V>
+void compact_avl_tree<K, V>::insert(K key, V value)
+{
+    if (nodes_.size() >= nil)
+        throw std::length_error{"compact_avl_tree is full"};
+    root_ = insert(root_, key, value);
+}
+
+template <class K, class V>
+uint32_t compact_avl_tree<K, V>::insert(uint32_t subtree, K& key, V& value)
+{
+    if (subtree == nil)
+    {
+        nodes_.emplace_back(std::move(key), std::move(value));
+        return static_cast<uint32_t>(nodes_.size() - 1);
+    }
+
+    // nodes_ may reallocate during the recursive call, so only hold on
+    // to indices across it
+    if (key < nodes_[subtree].key)
+    {
+        auto child = insert(nodes_[subtree].left, key, value);
+        nodes_[subtree].left = child;
+    }
+    else
+    {
+        auto child = insert(nodes_[subtree].right, key, value);
+        nodes_[subtree].right = child;
+    }
+
+    return rebalance(subtree);
+}
+
+template <class K, class V>
+uint32_t compact_avl_tree<K, V>::rebalance(uint32_t subroot)
+{
+    const auto& n = nodes_[subroot];
+    auto balance = heightOrNeg1(n.left) - heightOrNeg1(n.right);
+    if (balance == 2)
+    {
+        const auto& l = nodes_[n.left];
+        if (heightOrNeg1(l.left) - heightOrNeg1(l.right) < 0)
+            nodes_[subroot].left = rotate_left(n.left);
+        return rotate_right(subroot);
+    }
+    else if (balance == -2)
+    {
+        const auto& r = nodes_[n.right];
+        if (heightOrNeg1(r.left) - heightOrNeg1(r.right) > 0)
+            nodes_[subroot].right = rotate_right(n.right);
+        return rotate_left(subroot);
+    }
+    update_height(subroot);
+    return subroot;
+}
+
+template <class K, class V>
+uint32_t compact_avl_tree<K, V>::rotate_left(uint32_t t)
+{
+    auto pivot = nodes_[t].right;
+    nodes_[t].right = nodes_[pivot].left;
+    nodes_[pivot].left = t;
+    update_height(t);
+    update_height(pivot);
+    return pivot;
+}
+
+template <class K, class V>
+uint32_t compact_avl_tree<K, V>::rotate_right(uint32_t t)
+{
+    auto pivot = nodes_[t].left;
+    nodes_[t].left = nodes_[pivot].right;
+    nodes_[pivot].right = t;
+    update_height(t);
+    update_height(pivot);
+    return pivot;
+}
+
+template <class K, class V>
+void compact_avl_tree<K, V>::update_height(uint32_t idx)
+{
+    auto& n = nodes_[idx];
+    n.height = static_cast<int8_t>(
+        1 + std::max(heightOrNeg1(n.left), heightOrNeg1(n.right)));
+}
+
+template <class K, class V>
+int compact_avl_tree<K, V>::heightOrNeg1(uint32_t idx) const
+{
+    return idx == nil ? -1 : nodes_[idx].height;
+}
@@ -0,0 +1,162 @@
+/**
+ * @file persistent_avl_tree.h
+ * Declaration of the persistent_avl_tree class, an AVL tree whose readers
+ * work on immutable snapshots while a writer inserts.
+ */
+
+#ifndef PERSISTENT_AVLTREE_H_
+#define PERSISTENT_AVLTREE_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+/**
+ * The persistent_avl_tree class is an AVL tree built from immutable nodes.
+ * insert never modifies an existing node: it copies the path from the root
+ * to the insertion point (plus the few nodes touched by rotations) and
+ * shares every other subtree with the previous version, then publishes the
+ * new root atomically.
+ *
+ * Readers call get_snapshot() to grab the current root and search it without
+ * taking the writer lock, so they never wait for a rebalance. Writers are
+ * serialized among themselves. Nodes are reference counted, so a retired
+ * node is freed as soon as the last snapshot that can reach it goes away.
+ */
+template <class K, class V>
+class persistent_avl_tree
+{
+  private:
+    struct node;
+    using node_ptr = std::shared_ptr<const node>;
+
+    /**
+     * Represents an immutable tree node. Children are shared between
+     * every version of the tree that contains them.
+     */
+    struct node
+    {
+        K key;
+        V value;
+        node_ptr left;
+        node_ptr right;
+        int64_t height;
+
+        /**
+         * node element constructor.
+         * @param k The object to use as a key
+         * @param v The data element the node will hold
+         * @param l The left subtree
+         * @param r The right subtree
+         */
+        node(K k, V v, node_ptr l, node_ptr r);
+    };
+
+  public:
+    /**
+     * A read-only view of the tree as of the moment it was taken. Later
+     * inserts into the tree are not visible through it.
+     */
+    class snapshot
+    {
+      public:
+        /**
+         * Finds an element in this version of the tree.
+         * @param key The element to search for
+         * @return the value stored for that key
+         */
+        const V& find(const K& key) const;
+
+      private:
+        friend class persistent_avl_tree;
+
+        snapshot(node_ptr root);
+
+        node_ptr root_;
+    };
+
+    /**
+     * Constructor to create an empty tree.
+     */
+    persistent_avl_tree() = default;
+
+    /**
+     * Copy constructor. The new tree shares all of its nodes with other.
+     */
+    persistent_avl_tree(const persistent_avl_tree& other);
+
+    /**
+     * Assignment operator.
+     * @param rhs The tree to make a copy of
+     * @return A reference to the current tree
+     */
+    persistent_avl_tree& operator=(const persistent_avl_tree& rhs);
+
+    /**
+     * Inserts into the tree, publishing a new version. Safe to call
+     * concurrently with other inserts and with readers.
+     * @param key The key to insert
+     * @param value The value for the key to insert
+     */
+    void insert(K key, V value);
+
+    /**
+     * Finds an element in the current version of the tree. The returned
+     * reference is only guaranteed to live until the next insert; readers
+     * running alongside a writer should search a snapshot instead.
+     * @param key The element to search for
+     * @return the value stored for that key
+     */
+    const V& find(const K& key) const;
+
+    /**
+     * @return a snapshot of the current version of the tree
+     */
+    snapshot get_snapshot() const;
+
+  private:
+    /// Root of the current version; only accessed with std::atomic_*
+    node_ptr root_;
+    /// Serializes writers so no insert is lost
+    std::mutex write_lock_;
+
+    /**
+     * @return the root of the current version
+     */
+    node_ptr load_root() const;
+
+    /**
+     * Finds an element in a given version of the tree.
+     * @param subtree The node to search from (current subroot)
+     * @param key The element to search for
+     * @return the value stored for that key
+     */
+    static const V& find(const node* subtree, const K& key);
+
+    /**
+     * Private helper function for the public insert function.
+     * @param subtree The current node in the recursion
+     * @param key The key to insert
+     * @param value The value for the key to insert
+     * @return the root of the new version of subtree
+     */
+    static node_ptr insert(const node* subtree, K key, V value);
+
+    /**
+     * Builds a new node from the given parts, rotating if the children
+     * are out of balance.
+     * @return the root of the balanced subtree
+     */
+    static node_ptr balance(const K& key, const V& value, node_ptr left,
+                            node_ptr right);
+
+    /**
+     * @param node The node's height to check
+     * @return the height of the node if it's non-NULL or -1 if it is NULL
+     */
+    static int64_t heightOrNeg1(const node* node);
+};
+
+#include "persistent_avl_tree.tcc"
+#endif
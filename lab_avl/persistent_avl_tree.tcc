@@ -0,0 +1,167 @@
+/**
+ * @file persistent_avl_tree.tcc
+ * Definitions of the persistent_avl_tree functions.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+#include "persistent_avl_tree.h"
+
+template <class K, class V>
+persistent_avl_tree<K, V>::node::node(K k, V v, node_ptr l, node_ptr r)
+    : key{std::move(k)},
+      value{std::move(v)},
+      left{std::move(l)},
+      right{std::move(r)},
+      height{1 + std::max(heightOrNeg1(left.get()), heightOrNeg1(right.get()))}
+{
+    // nothing
+}
+
+template <class K, class V>
+persistent_avl_tree<K, V>::snapshot::snapshot(node_ptr root)
+    : root_{std::move(root)}
+{
+    // nothing
+}
+
+template <class K, class V>
+const V& persistent_avl_tree<K, V>::snapshot::find(const K& key) const
+{
+    return persistent_avl_tree::find(root_.get(), key);
+}
+
+template <class K, class V>
+persistent_avl_tree<K, V>::persistent_avl_tree(const persistent_avl_tree& other)
+    : root_{other.load_root()}
+{
+    // nothing
+}
+
+template <class K, class V>
+persistent_avl_tree<K, V>&
+    persistent_avl_tree<K, V>::operator=(const persistent_avl_tree& rhs)
+{
+    if (this != &rhs)
+    {
+        auto root = rhs.load_root();
+        std::lock_guard<std::mutex> lock{write_lock_};
+        std::atomic_store(&root_, std::move(root));
+    }
+    return *this;
+}
+
+template <class K, class V>
+auto persistent_avl_tree<K, V>::load_root() const -> node_ptr
+{
+    return std::atomic_load(&root_);
+}
+
+template <class K, class V>
+auto persistent_avl_tree<K, V>::get_snapshot() const -> snapshot
+{
+    return snapshot{load_root()};
+}
+
+template <class K, class V>
+const V& persistent_avl_tree<K, V>::find(const K& key) const
+{
+    return find(load_root().get(), key);
+}
+
+template <class K, class V>
+const V& persistent_avl_tree<K, V>::find(const node* subtree, const K& key)
+{
+    while (subtree)
+    {
+        if (key == subtree->key)
+            return subtree->value;
+        subtree = key < subtree->key ? subtree->left.get()
+                                     : subtree->right.get();
+    }
+    throw std::out_of_range{"invalid key"};
+}
+
+template <class K, class V>
+void persistent_avl_tree<K, V>::insert(K key, V value)
+{
+    std::lock_guard<std::mutex> lock{write_lock_};
+    auto root = load_root();
+    std::atomic_store(&root_,
+                      insert(root.get(), std::move(key), std::move(value)));
+}
+
+template <class K, class V>
+auto persistent_avl_tree<K, V>::insert(const node* subtree, K key, V value)
+    -> node_ptr
+{
+    if (!subtree)
+        return std::make_shared<const node>(std::move(key), std::move(value),
+                                            nullptr, nullptr);
+
+    if (key < subtree->key)
+        return balance(subtree->key, subtree->value,
+                       insert(subtree->left.get(), std::move(key),
+                              std::move(value)),
+                       subtree->right);
+
+    return balance(subtree->key, subtree->value, subtree->left,
+                   insert(subtree->right.get(), std::move(key),
+                          std::move(value)));
+}
+
+template <class K, class V>
+auto persistent_avl_tree<K, V>::balance(const K& key, const V& value,
+                                        node_ptr left, node_ptr right)
+    -> node_ptr
+{
+    auto balance = heightOrNeg1(left.get()) - heightOrNeg1(right.get());
+    if (balance == 2)
+    {
+        if (heightOrNeg1(left->left.get()) >= heightOrNeg1(left->right.get()))
+        {
+            // rotate right
+            auto t = std::make_shared<const node>(key, value, left->right,
+                                                  std::move(right));
+            return std::make_shared<const node>(left->key, left->value,
+                                                left->left, std::move(t));
+        }
+        // rotate left-right
+        const auto& pivot = left->right;
+        auto l = std::make_shared<const node>(left->key, left->value,
+                                              left->left, pivot->left);
+        auto r = std::make_shared<const node>(key, value, pivot->right,
+                                              std::move(right));
+        return std::make_shared<const node>(pivot->key, pivot->value,
+                                            std::move(l), std::move(r));
+    }
+    else if (balance == -2)
+    {
+        if (heightOrNeg1(right->right.get()) >= heightOrNeg1(right->left.get()))
+        {
+            // rotate left
+            auto t = std::make_shared<const node>(key, value, std::move(left),
+                                                  right->left);
+            return std::make_shared<const node>(right->key, right->value,
+                                                std::move(t), right->right);
+        }
+        // rotate right-left
+        const auto& pivot = right->left;
+        auto l = std::make_shared<const node>(key, value, std::move(left),
+                                              pivot->left);
+        auto r = std::make_shared<const node>(right->key, right->value,
+                                              pivot->right, right->right);
+        return std::make_shared<const node>(pivot->key, pivot->value,
+                                            std::move(l), std::move(r));
+    }
+    return std::make_shared<const node>(key, value, std::move(left),
+                                        std::move(right));
+}
+
+template <class K, class V>
+int64_t persistent_avl_tree<K, V>::heightOrNeg1(const node* node)
+{
+    return node ? node->height : -1;
+}
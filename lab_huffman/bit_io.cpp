@@ -0,0 +1,178 @@
+/**
+ * @file bit_io.cpp
+ * Implementation of word-at-a-time bit readers and writers, and of a
+ * memory-mapped input file.
+ */
+
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bit_io.h"
+
+using namespace std;
+
+mapped_file::mapped_file(const string& filename) : data_{nullptr}, size_{0}
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error{"could not open " + filename};
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error{"could not stat " + filename};
+    }
+    size_ = info.st_size;
+
+    // mmap rejects empty mappings; an empty file needs none
+    if (size_ > 0)
+    {
+        auto addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error{"could not map " + filename};
+        }
+        data_ = static_cast<const char*>(addr);
+        ::madvise(addr, size_, MADV_SEQUENTIAL);
+    }
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+}
+
+mapped_file::mapped_file(mapped_file&& other)
+    : data_{other.data_}, size_{other.size_}
+{
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& rhs)
+{
+    std::swap(data_, rhs.data_);
+    std::swap(size_, rhs.size_);
+    return *this;
+}
+
+mapped_file::~mapped_file()
+{
+    if (data_)
+        ::munmap(const_cast<char*>(data_), size_);
+}
+
+const char* mapped_file::data() const
+{
+    return data_;
+}
+
+size_t mapped_file::size() const
+{
+    return size_;
+}
+
+bit_reader::bit_reader(const char* data, size_t size, int last_byte_bits)
+    : pos_{reinterpret_cast<const uint8_t*>(data)},
+      end_{pos_ + size},
+      bits_left_{size == 0 ? 0 : 8 * size - (8 - last_byte_bits)}
+{
+    if (last_byte_bits < 1 || last_byte_bits > 8)
+        throw std::invalid_argument{"invalid number of bits in last byte"};
+}
+
+bit_reader::bit_reader(const mapped_file& file)
+    : bit_reader{file.data(), file.size()}
+{
+    // nothing
+}
+
+void bit_reader::refill()
+{
+    if (end_ - pos_ >= 8)
+    {
+        // load a whole word and keep as many of its bytes as fit
+        uint64_t word = 0;
+        for (int i = 0; i < 8; ++i)
+            word = (word << 8) | pos_[i];
+        int bytes = (64 - count_) / 8;
+        buffer_ = bytes == 8 ? word
+                             : (buffer_ << (8 * bytes))
+                                   | (word >> (64 - 8 * bytes));
+        pos_ += bytes;
+        count_ += 8 * bytes;
+        return;
+    }
+    for (; count_ <= 56 && pos_ != end_; count_ += 8)
+        buffer_ = (buffer_ << 8) | *pos_++;
+}
+
+uint64_t bit_reader::peek_bits(int n)
+{
+    if (count_ < n)
+        refill();
+    auto mask = (uint64_t{1} << n) - 1;
+    // near the end of the input, pad with zeros
+    if (count_ < n)
+        return (buffer_ << (n - count_)) & mask;
+    return (buffer_ >> (count_ - n)) & mask;
+}
+
+uint64_t bit_reader::read_bits(int n)
+{
+    auto bits = peek_bits(n);
+    skip_bits(n);
+    return bits;
+}
+
+void bit_reader::skip_bits(int n)
+{
+    if (static_cast<size_t>(n) > bits_left_)
+        throw std::runtime_error{"read past the end of the input"};
+    if (count_ < n)
+        refill();
+    count_ -= n;
+    bits_left_ -= n;
+}
+
+size_t bit_reader::bits_left() const
+{
+    return bits_left_;
+}
+
+bit_writer::bit_writer(string& out) : out_(out)
+{
+    // nothing
+}
+
+void bit_writer::write_bits(uint64_t bits, int n)
+{
+    if (count_ + n > 64)
+    {
+        for (; count_ >= 8; count_ -= 8)
+            out_.push_back(static_cast<char>(buffer_ >> (count_ - 8)));
+    }
+    buffer_ = (buffer_ << n) | bits;
+    count_ += n;
+    bits_written_ += n;
+}
+
+void bit_writer::flush()
+{
+    for (; count_ >= 8; count_ -= 8)
+        out_.push_back(static_cast<char>(buffer_ >> (count_ - 8)));
+    if (count_ > 0)
+    {
+        out_.push_back(static_cast<char>(buffer_ << (8 - count_)));
+        count_ = 0;
+    }
+}
+
+size_t bit_writer::bits_written() const
+{
+    return bits_written_;
+}
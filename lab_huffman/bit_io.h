@@ -0,0 +1,196 @@
+/**
+ * @file bit_io.h
+ * Definitions of word-at-a-time bit readers and writers, and of a
+ * memory-mapped input file.
+ */
+
+#ifndef BIT_IO_H_
+#define BIT_IO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * mapped_file: a read-only file mapped into memory, so that it can be
+ * read without copying it into a buffer first.
+ */
+class mapped_file
+{
+  public:
+    /**
+     * Maps a file into memory.
+     *
+     * @param filename The file to map.
+     */
+    mapped_file(const std::string& filename);
+
+    mapped_file(const mapped_file& other) = delete;
+    mapped_file& operator=(const mapped_file& rhs) = delete;
+
+    /**
+     * Move constructor: the other mapped_file is left empty.
+     *
+     * @param other The mapped_file to move from.
+     */
+    mapped_file(mapped_file&& other);
+
+    /**
+     * Move assignment: the other mapped_file is left empty.
+     *
+     * @param rhs The mapped_file to move from.
+     * @return A reference for performing chained assignments.
+     */
+    mapped_file& operator=(mapped_file&& rhs);
+
+    /**
+     * Unmaps the file.
+     */
+    ~mapped_file();
+
+    /**
+     * @return The contents of the file.
+     */
+    const char* data() const;
+
+    /**
+     * @return The number of bytes in the file.
+     */
+    size_t size() const;
+
+  private:
+    /// The mapped contents of the file (null for an empty file)
+    const char* data_;
+    /// The number of bytes in the file
+    size_t size_;
+};
+
+/**
+ * bit_reader: reads bits, most significant bit of each byte first, from
+ * a buffer in memory. Bits are kept in a 64-bit buffer that is refilled
+ * a word at a time, so reading n bits costs a shift and a mask rather
+ * than n calls.
+ */
+class bit_reader
+{
+  public:
+    /**
+     * Creates a reader for a buffer. The buffer is not copied and must
+     * outlive the reader.
+     *
+     * @param data The bytes to read from.
+     * @param size The number of bytes.
+     * @param last_byte_bits The number of bits of the last byte that are
+     * part of the input, from its most significant bit down.
+     */
+    bit_reader(const char* data, size_t size, int last_byte_bits = 8);
+
+    /**
+     * Creates a reader for a whole mapped file.
+     *
+     * @param file The file to read from; must outlive the reader.
+     */
+    explicit bit_reader(const mapped_file& file);
+
+    /**
+     * Returns the next bits without consuming them. Past the end of the
+     * input the result is padded with zero bits; callers can compare
+     * against bits_left to tell padding from input.
+     *
+     * @param n The number of bits to return, at most max_bits.
+     * @return The next n bits, the first of them the most significant.
+     */
+    uint64_t peek_bits(int n);
+
+    /**
+     * Reads and consumes the next bits.
+     *
+     * @param n The number of bits to read, at most max_bits.
+     * @return The next n bits, the first of them the most significant.
+     */
+    uint64_t read_bits(int n);
+
+    /**
+     * Consumes bits without returning them.
+     *
+     * @param n The number of bits to skip, at most max_bits.
+     */
+    void skip_bits(int n);
+
+    /**
+     * @return The number of bits of input not yet consumed.
+     */
+    size_t bits_left() const;
+
+    /// Most bits that can be read at once
+    const static int max_bits = 57;
+
+  private:
+    /**
+     * Tops up buffer_ so that it holds at least max_bits bits, or all the
+     * input left if there are fewer.
+     */
+    void refill();
+
+    /// Next byte to load into buffer_
+    const uint8_t* pos_;
+    /// End of the input
+    const uint8_t* end_;
+    /// The low count_ bits are loaded but unconsumed, oldest first
+    uint64_t buffer_ = 0;
+    /// Number of bits held in buffer_
+    int count_ = 0;
+    /// Number of bits of input not yet consumed
+    size_t bits_left_;
+};
+
+/**
+ * bit_writer: appends bits, most significant bit of each byte first, to
+ * a string. Bits are collected in a 64-bit buffer and only moved to the
+ * string a byte at a time once the buffer is full.
+ */
+class bit_writer
+{
+  public:
+    /**
+     * Creates a writer that appends to a string.
+     *
+     * @param out The string to append to; must outlive the writer.
+     */
+    explicit bit_writer(std::string& out);
+
+    /**
+     * Appends bits.
+     *
+     * @param bits The bits to write, in the low n bits; the most
+     * significant of them is written first.
+     * @param n The number of bits to write, at most max_bits.
+     */
+    void write_bits(uint64_t bits, int n);
+
+    /**
+     * Appends every buffered bit to the string, padding the last byte
+     * with zero bits. Writing may continue afterwards, from the next
+     * byte.
+     */
+    void flush();
+
+    /**
+     * @return The number of bits written, not counting any padding.
+     */
+    size_t bits_written() const;
+
+    /// Most bits that can be written at once
+    const static int max_bits = 57;
+
+  private:
+    /// The string being appended to
+    std::string& out_;
+    /// The low count_ bits are pending output, oldest first
+    uint64_t buffer_ = 0;
+    /// Number of bits held in buffer_
+    int count_ = 0;
+    /// Number of bits written
+    size_t bits_written_ = 0;
+};
+#endif
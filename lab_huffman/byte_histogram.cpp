@@ -0,0 +1,165 @@
+/**
+ * @file byte_histogram.cpp
+ * Implementation of a byte frequency counter used to build huffman_trees.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+#include "byte_histogram.h"
+
+using namespace std;
+
+namespace
+{
+unsigned default_threads()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+}
+
+byte_histogram::byte_histogram()
+{
+    counts_.fill(0);
+}
+
+void byte_histogram::add(const char* data, size_t size)
+{
+    auto bytes = reinterpret_cast<const uint8_t*>(data);
+    // 32-bit tables keep all of them within a few cache lines; count in
+    // slabs small enough that no table entry can overflow
+    const size_t slab_size = size_t{1} << 31;
+    uint32_t tables[num_tables_][256];
+
+    while (size > 0)
+    {
+        auto slab = std::min(size, slab_size);
+        std::memset(tables, 0, sizeof(tables));
+
+        size_t i = 0;
+        for (; i + 8 <= slab; i += 8)
+        {
+            // one 8 byte load, then each byte to the next table in turn
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            ++tables[0][word & 0xff];
+            ++tables[1][(word >> 8) & 0xff];
+            ++tables[2][(word >> 16) & 0xff];
+            ++tables[3][(word >> 24) & 0xff];
+            ++tables[0][(word >> 32) & 0xff];
+            ++tables[1][(word >> 40) & 0xff];
+            ++tables[2][(word >> 48) & 0xff];
+            ++tables[3][word >> 56];
+        }
+        for (; i < slab; ++i)
+            ++tables[i % num_tables_][bytes[i]];
+
+        for (int c = 0; c < 256; ++c)
+        {
+            for (int t = 0; t < num_tables_; ++t)
+                counts_[c] += tables[t][c];
+        }
+        bytes += slab;
+        size -= slab;
+    }
+}
+
+void byte_histogram::add_parallel(const char* data, size_t size,
+                                  unsigned threads)
+{
+    if (threads == 0)
+        threads = default_threads();
+    threads = static_cast<unsigned>(
+        std::min<size_t>(threads, size / min_parallel_size_));
+    if (threads <= 1)
+    {
+        add(data, size);
+        return;
+    }
+
+    // each thread counts its own contiguous range into its own histogram
+    vector<byte_histogram> partial(threads);
+    vector<std::thread> pool;
+    auto range = size / threads;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        auto begin = t * range;
+        auto end = t + 1 == threads ? size : begin + range;
+        pool.emplace_back([&, t, begin, end]()
+        {
+            partial[t].add(data + begin, end - begin);
+        });
+    }
+    for (auto& t : pool)
+        t.join();
+
+    for (const auto& p : partial)
+    {
+        for (int c = 0; c < 256; ++c)
+            counts_[c] += p.counts_[c];
+    }
+}
+
+size_t byte_histogram::parallel_size(unsigned threads)
+{
+    if (threads == 0)
+        threads = default_threads();
+    return threads * min_parallel_size_;
+}
+
+uint64_t byte_histogram::count(char c) const
+{
+    return counts_[static_cast<uint8_t>(c)];
+}
+
+uint64_t byte_histogram::total() const
+{
+    uint64_t sum = 0;
+    for (const auto& count : counts_)
+        sum += count;
+    return sum;
+}
+
+vector<frequency> byte_histogram::frequencies() const
+{
+    // frequency counts are ints, and so are the sums the tree is built of
+    auto counts = counts_;
+    fit_counts(counts);
+    vector<frequency> result;
+    for (int c = 0; c < 256; ++c)
+    {
+        if (counts[c])
+            result.emplace_back(static_cast<char>(c),
+                                static_cast<int>(counts[c]));
+    }
+    return result;
+}
+
+void byte_histogram::fit_counts(std::array<uint64_t, 256>& counts)
+{
+    auto scaled_total = [&](int shift)
+    {
+        uint64_t sum = 0;
+        for (auto count : counts)
+        {
+            if (count)
+                sum += std::max<uint64_t>(count >> shift, 1);
+        }
+        return sum;
+    };
+
+    // at most 256 counts of 1 are left at the largest shift, which fits
+    const auto limit = static_cast<uint64_t>(std::numeric_limits<int>::max());
+    int shift = 0;
+    while (scaled_total(shift) > limit)
+        ++shift;
+    if (shift == 0)
+        return;
+    for (auto& count : counts)
+    {
+        if (count)
+            count = std::max<uint64_t>(count >> shift, 1);
+    }
+}
@@ -0,0 +1,104 @@
+/**
+ * @file byte_histogram.h
+ * Definition of a byte frequency counter used to build huffman_trees.
+ */
+
+#ifndef BYTE_HISTOGRAM_H_
+#define BYTE_HISTOGRAM_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "frequency.h"
+
+/**
+ * byte_histogram: counts how often each byte value occurs in some data,
+ * producing the frequency objects a huffman_tree is built from.
+ *
+ * Counting a byte is a load, increment and store to the counter for that
+ * byte. When the same byte repeats, each increment has to wait for the
+ * previous store to that counter, which serializes the loop. add therefore
+ * spreads consecutive bytes over several independent count tables and
+ * only sums them at the end, and add_parallel also splits the data across
+ * threads.
+ */
+class byte_histogram
+{
+  public:
+    /**
+     * Creates a histogram with every count at zero.
+     */
+    byte_histogram();
+
+    /**
+     * Counts the bytes in a buffer on the calling thread.
+     *
+     * @param data The bytes to count.
+     * @param size The number of bytes to count.
+     */
+    void add(const char* data, size_t size);
+
+    /**
+     * Counts the bytes in a buffer, splitting large buffers across
+     * threads.
+     *
+     * @param data The bytes to count.
+     * @param size The number of bytes to count.
+     * @param threads The number of threads to count with (0 to use one
+     * per hardware thread).
+     */
+    void add_parallel(const char* data, size_t size, unsigned threads = 0);
+
+    /**
+     * @param threads The number of threads (0 for one per hardware
+     * thread).
+     * @return The smallest buffer add_parallel splits across that many
+     * threads; callers reading data in chunks should read at least this
+     * much at a time.
+     */
+    static size_t parallel_size(unsigned threads = 0);
+
+    /**
+     * @param c The character to get the count of.
+     * @return How many times the character has been counted.
+     */
+    uint64_t count(char c) const;
+
+    /**
+     * @return The total number of bytes counted.
+     */
+    uint64_t total() const;
+
+    /**
+     * @return A frequency object for every character counted at least
+     * once, in character order. Once the counts add up to more than an
+     * int holds, they are scaled down as by fit_counts.
+     */
+    std::vector<frequency> frequencies() const;
+
+    /**
+     * Scales counts down by the smallest power of two that makes their
+     * total fit in an int, keeping every nonzero count at least 1. A
+     * Huffman code only depends on the ratios of the counts, so large
+     * inputs still get (very nearly) the codes they would have had.
+     *
+     * @param counts The count of each byte value, scaled in place.
+     */
+    static void fit_counts(std::array<uint64_t, 256>& counts);
+
+  private:
+    /// Number of interleaved count tables used by add
+    const static int num_tables_ = 4;
+
+    /**
+     * Number of bytes below which add_parallel does not bother starting
+     * threads.
+     */
+    const static size_t min_parallel_size_ = 1 << 20;
+
+    /// Count of each byte value
+    std::array<uint64_t, 256> counts_;
+};
+#endif
@@ -0,0 +1,443 @@
+/**
+ * @file huffman_bench.cpp
+ * Benchmark of the Huffman coding paths on synthetic corpora.
+ *
+ * Usage: huffman_bench [megabytes per corpus] [iterations]
+ *
+ * For each corpus and each coding path, reports the time to build the
+ * trees, encode and decode throughput (the best of the iterations), the
+ * encoded size in bits per symbol and the peak resident memory. Each
+ * measurement runs in its own child process, so that the peak memory
+ * belongs to that path alone.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "byte_histogram.h"
+#include "huffman_blocks.h"
+#include "huffman_multi_table.h"
+#include "huffman_tree.h"
+
+using namespace std;
+
+namespace
+{
+/**
+ * Timings and size of one run of a coding path. Paths whose encoder
+ * builds its own trees report a build time of zero.
+ */
+struct result
+{
+    double build_seconds = 0;
+    double encode_seconds = 0;
+    double decode_seconds = 0;
+    size_t encoded_size = 0;
+};
+
+/// A coding path: encodes and decodes the data once, timing each step
+using coding_path = std::function<result(const string&)>;
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                         - start).count();
+}
+
+void check_round_trip(const string& data, const string& decoded)
+{
+    if (decoded != data)
+        throw std::runtime_error{"decoded data does not match"};
+}
+
+/**
+ * Runs a path that codes the data with a single huffman_tree.
+ *
+ * @param make_tree Builds the encoding tree from the data's frequencies.
+ * @param from_lengths Whether to decode with a tree rebuilt from the
+ * code lengths (no nodes) rather than with the encoding tree; the
+ * encoding tree must then be canonical.
+ */
+result run_single_tree(
+    const string& data,
+    const std::function<huffman_tree(const vector<frequency>&)>& make_tree,
+    bool from_lengths)
+{
+    result r;
+    auto start = std::chrono::steady_clock::now();
+    byte_histogram histogram;
+    histogram.add_parallel(data.data(), data.size());
+    auto tree = make_tree(histogram.frequencies());
+    r.build_seconds = seconds_since(start);
+
+    string encoded;
+    start = std::chrono::steady_clock::now();
+    tree.encode_chunk(data.data(), data.size(), encoded);
+    r.encode_seconds = seconds_since(start);
+    r.encoded_size = encoded.size();
+
+    string decoded(data.size(), '\0');
+    start = std::chrono::steady_clock::now();
+    if (from_lengths)
+    {
+        huffman_tree decoder{tree.code_lengths()};
+        decoder.decode_chunk(encoded.data(), encoded.size(), &decoded[0],
+                             decoded.size());
+    }
+    else
+    {
+        tree.decode_chunk(encoded.data(), encoded.size(), &decoded[0],
+                          decoded.size());
+    }
+    r.decode_seconds = seconds_since(start);
+    check_round_trip(data, decoded);
+    return r;
+}
+
+/**
+ * Runs a path whose encoder builds its own trees.
+ */
+template <class Container, class Encode>
+result run_container(const string& data, Encode encode)
+{
+    result r;
+    auto start = std::chrono::steady_clock::now();
+    auto encoded = encode(data);
+    r.encode_seconds = seconds_since(start);
+    r.encoded_size = encoded.size();
+
+    start = std::chrono::steady_clock::now();
+    auto decoded = Container{encoded.data(), encoded.size()}.decode();
+    r.decode_seconds = seconds_since(start);
+    check_round_trip(data, decoded);
+    return r;
+}
+
+/**
+ * Runs the streaming path: counts, encodes and decodes through streams,
+ * one default sized chunk at a time.
+ */
+result run_stream(const string& data)
+{
+    result r;
+    std::istringstream in{data};
+    auto start = std::chrono::steady_clock::now();
+    huffman_tree tree{huffman_tree::stream_frequencies(in)};
+    r.build_seconds = seconds_since(start);
+
+    std::ostringstream encoded;
+    start = std::chrono::steady_clock::now();
+    tree.write_stream(in, encoded);
+    r.encode_seconds = seconds_since(start);
+    r.encoded_size = encoded.str().size();
+
+    std::istringstream encoded_in{encoded.str()};
+    std::ostringstream decoded;
+    start = std::chrono::steady_clock::now();
+    huffman_tree::decode_stream(encoded_in, decoded);
+    r.decode_seconds = seconds_since(start);
+    check_round_trip(data, decoded.str());
+    return r;
+}
+
+vector<std::pair<string, coding_path>> coding_paths()
+{
+    return {
+        {"tree",
+         [](const string& data)
+         {
+             return run_single_tree(
+                 data, [](const vector<frequency>& f)
+                 { return huffman_tree{f}; },
+                 false);
+         }},
+        {"canonical",
+         [](const string& data)
+         {
+             return run_single_tree(
+                 data, [](const vector<frequency>& f)
+                 {
+                     huffman_tree tree{f};
+                     tree.canonicalize();
+                     return tree;
+                 },
+                 true);
+         }},
+        {"limited",
+         [](const string& data)
+         {
+             // short enough that every code decodes in one table probe
+             return run_single_tree(
+                 data, [](const vector<frequency>& f)
+                 {
+                     huffman_tree tree{f, 10};
+                     tree.canonicalize();
+                     return tree;
+                 },
+                 true);
+         }},
+        {"blocks",
+         [](const string& data)
+         {
+             return run_container<huffman_blocks>(
+                 data, [](const string& d)
+                 { return huffman_blocks::encode(d.data(), d.size()); });
+         }},
+        {"multi",
+         [](const string& data)
+         {
+             return run_container<huffman_multi_table>(
+                 data, [](const string& d)
+                 { return huffman_multi_table::encode(d.data(), d.size()); });
+         }},
+        {"stream", run_stream},
+    };
+}
+
+/**
+ * Checks that trees can be built from counts adding up to more than an
+ * int holds, as multi-gigabyte inputs do, and still code data.
+ */
+void check_large_counts()
+{
+    const int most = std::numeric_limits<int>::max();
+    vector<frequency> frequencies{{'a', most}, {'b', most}, {'c', 1000}};
+    const string data = "abcab";
+    for (auto tree : {huffman_tree{frequencies}, huffman_tree{frequencies, 2}})
+    {
+        string encoded;
+        tree.encode_chunk(data.data(), data.size(), encoded);
+        string decoded(data.size(), '\0');
+        tree.decode_chunk(encoded.data(), encoded.size(), &decoded[0],
+                          decoded.size());
+        check_round_trip(data, decoded);
+    }
+}
+
+/// Every byte value equally likely
+string uniform_corpus(size_t size, std::mt19937_64& rng)
+{
+    string out(size, '\0');
+    for (auto& c : out)
+        c = static_cast<char>(rng());
+    return out;
+}
+
+/// A few byte values make up most of the data, with a long tail
+string skewed_corpus(size_t size, std::mt19937_64& rng)
+{
+    std::geometric_distribution<int> dist{0.2};
+    string out(size, '\0');
+    for (auto& c : out)
+        c = static_cast<char>(std::min(dist(rng), 255));
+    return out;
+}
+
+/// Words drawn from a Zipf-like distribution, in lines of text
+string text_corpus(size_t size, std::mt19937_64& rng)
+{
+    const int num_words = 5000;
+    vector<string> words;
+    std::uniform_int_distribution<int> length{1, 10};
+    std::discrete_distribution<int> letter{
+        {8.2, 1.5, 2.8, 4.3, 12.7, 2.2, 2.0, 6.1, 7.0, 0.2, 0.8, 4.0, 2.4,
+         6.7, 7.5, 1.9, 0.1, 6.0, 6.3, 9.1, 2.8, 1.0, 2.4, 0.2, 2.0, 0.1}};
+    for (int w = 0; w < num_words; ++w)
+    {
+        string word;
+        for (int i = length(rng); i > 0; --i)
+            word.push_back(static_cast<char>('a' + letter(rng)));
+        words.push_back(word);
+    }
+
+    vector<double> weights;
+    for (int w = 1; w <= num_words; ++w)
+        weights.push_back(1.0 / w);
+    std::discrete_distribution<int> pick{weights.begin(), weights.end()};
+    std::uniform_int_distribution<int> punctuation{0, 15};
+
+    string out;
+    out.reserve(size + 16);
+    for (int n = 1; out.size() < size; ++n)
+    {
+        auto word = words[pick(rng)];
+        if (n % 12 == 1)
+            word[0] = static_cast<char>(word[0] - 'a' + 'A');
+        out += word;
+        if (punctuation(rng) == 0)
+            out.push_back(',');
+        out.push_back(n % 12 == 0 ? '\n' : ' ');
+    }
+    out.resize(size);
+    return out;
+}
+
+/// Fixed-size little endian records: a counter, a small value and a
+/// mostly zero field
+string binary_corpus(size_t size, std::mt19937_64& rng)
+{
+    std::geometric_distribution<uint32_t> small{0.05};
+    string out;
+    out.reserve(size + 16);
+    for (uint32_t id = 0; out.size() < size; ++id)
+    {
+        uint32_t fields[] = {id, small(rng), 0, 0};
+        if (rng() % 8 == 0)
+            fields[2] = static_cast<uint32_t>(rng());
+        for (auto f : fields)
+        {
+            for (int i = 0; i < 4; ++i)
+                out.push_back(static_cast<char>(f >> (8 * i)));
+        }
+    }
+    out.resize(size);
+    return out;
+}
+
+/// Alternating stretches of the other corpora
+string mixed_corpus(size_t size, std::mt19937_64& rng)
+{
+    const size_t stretch = 64 << 10;
+    string out;
+    out.reserve(size);
+    for (int i = 0; out.size() < size; ++i)
+    {
+        auto n = std::min(stretch, size - out.size());
+        switch (i % 3)
+        {
+            case 0:
+                out += text_corpus(n, rng);
+                break;
+            case 1:
+                out += binary_corpus(n, rng);
+                break;
+            default:
+                out += skewed_corpus(n, rng);
+                break;
+        }
+    }
+    return out;
+}
+
+/**
+ * Measures one path on one corpus in a child process and prints a row
+ * of the report.
+ */
+void measure(const string& corpus, const string& path_name,
+             const coding_path& path, const string& data, int iterations)
+{
+    std::cout.flush();
+    auto pid = ::fork();
+    if (pid < 0)
+        throw std::runtime_error{"fork failed"};
+    if (pid == 0)
+    {
+        int status = 0;
+        try
+        {
+            result best = path(data);
+            for (int i = 1; i < iterations; ++i)
+            {
+                auto r = path(data);
+                best.build_seconds = std::min(best.build_seconds,
+                                              r.build_seconds);
+                best.encode_seconds = std::min(best.encode_seconds,
+                                               r.encode_seconds);
+                best.decode_seconds = std::min(best.decode_seconds,
+                                               r.decode_seconds);
+            }
+            double mb = data.size() / 1e6;
+            std::printf("%-8s %-10s %9.2f %10.1f %10.1f %8.3f", corpus.c_str(),
+                        path_name.c_str(), 1e3 * best.build_seconds,
+                        mb / best.encode_seconds, mb / best.decode_seconds,
+                        8.0 * best.encoded_size / data.size());
+        }
+        catch (const std::exception& e)
+        {
+            std::printf("%-8s %-10s failed: %s", corpus.c_str(),
+                        path_name.c_str(), e.what());
+            status = 1;
+        }
+        std::fflush(stdout);
+        ::_exit(status);
+    }
+
+    int status;
+    struct rusage usage;
+    if (::wait4(pid, &status, 0, &usage) < 0)
+        throw std::runtime_error{"wait failed"};
+    // ru_maxrss is in kilobytes
+    std::printf(" %9.1f\n", usage.ru_maxrss / 1024.0);
+}
+}
+
+int main(int argc, char** argv)
+{
+    size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 3;
+    if (megabytes == 0 || iterations < 1)
+    {
+        std::cerr << "usage: " << argv[0]
+                  << " [megabytes per corpus] [iterations]" << std::endl;
+        return 1;
+    }
+    size_t size = megabytes << 20;
+
+    vector<std::pair<string, string (*)(size_t, std::mt19937_64&)>> corpora
+        = {{"uniform", uniform_corpus},
+           {"skewed", skewed_corpus},
+           {"text", text_corpus},
+           {"binary", binary_corpus},
+           {"mixed", mixed_corpus}};
+    auto paths = coding_paths();
+
+    // the degenerate input every format must still round-trip
+    for (const auto& path : paths)
+    {
+        try
+        {
+            path.second(string{});
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << path.first << " fails on empty input: " << e.what()
+                      << std::endl;
+            return 1;
+        }
+    }
+    try
+    {
+        check_large_counts();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "large counts fail: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::printf("%-8s %-10s %9s %10s %10s %8s %9s\n", "corpus", "path",
+                "build ms", "enc MB/s", "dec MB/s", "bits/sym", "peak MiB");
+    for (const auto& corpus : corpora)
+    {
+        std::mt19937_64 rng{225};
+        auto data = corpus.second(size, rng);
+        for (const auto& path : paths)
+            measure(corpus.first, path.first, path.second, data, iterations);
+    }
+    return 0;
+}
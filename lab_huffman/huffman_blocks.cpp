@@ -0,0 +1,213 @@
+/**
+ * @file huffman_blocks.cpp
+ * Implementation of a container of independently Huffman coded blocks.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "byte_histogram.h"
+#include "huffman_blocks.h"
+
+using namespace std;
+
+namespace
+{
+const char magic[] = {'H', 'U', 'F', 'B'};
+
+/// Size of the trailer: the block count and the index offset
+const size_t trailer_size = 4 + 8;
+
+/// Size of one index entry: offset, encoded size and decoded size
+const size_t index_entry_size = 8 + 4 + 4;
+
+void append_le(string& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        out.push_back(static_cast<char>(value >> (8 * i)));
+}
+
+uint64_t read_le(const char* data, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+        value |= uint64_t{static_cast<uint8_t>(data[i])} << (8 * i);
+    return value;
+}
+
+/**
+ * Calls func(i) for every i in [0, count) on a pool of threads, each
+ * thread taking the next unclaimed index until none are left. If any call
+ * throws, the remaining indices are skipped and the first exception is
+ * rethrown once every thread has finished.
+ */
+template <class Func>
+void parallel_for(size_t count, unsigned threads, Func func)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, count));
+    if (threads <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            func(i);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::mutex error_lock;
+    std::exception_ptr error;
+    auto work = [&]()
+    {
+        for (auto i = next++; i < count; i = next++)
+        {
+            try
+            {
+                func(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock{error_lock};
+                if (!error)
+                    error = std::current_exception();
+                next = count;
+            }
+        }
+    };
+    vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(work);
+    work();
+    for (auto& t : pool)
+        t.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+/**
+ * Encodes one block: its code lengths, then its data.
+ */
+string encode_block(const char* data, size_t size)
+{
+    byte_histogram histogram;
+    histogram.add(data, size);
+    auto frequencies = histogram.frequencies();
+
+    huffman_tree tree{frequencies};
+    tree.canonicalize();
+
+    string out;
+    huffman_tree::append_code_lengths(tree.code_lengths(), out);
+    tree.encode_chunk(data, size, out);
+    return out;
+}
+}
+
+huffman_blocks::huffman_blocks(const char* data, size_t size)
+    : data_{data}, size_{size}
+{
+    if (size < sizeof(magic) + trailer_size
+        || !std::equal(magic, magic + sizeof(magic), data))
+        throw std::runtime_error{"not a huffman block file"};
+
+    auto trailer = data + size - trailer_size;
+    auto count = read_le(trailer, 4);
+    auto index_offset = read_le(trailer + 4, 8);
+    if (index_offset > size - trailer_size
+        || count > (size - trailer_size - index_offset) / index_entry_size)
+        throw std::runtime_error{"corrupt huffman block index"};
+
+    blocks_.resize(count);
+    uint64_t decoded_offset = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto entry = data + index_offset + i * index_entry_size;
+        auto& block = blocks_[i];
+        block.offset = read_le(entry, 8);
+        block.encoded_size = read_le(entry + 8, 4);
+        block.decoded_size = read_le(entry + 12, 4);
+        block.decoded_offset = decoded_offset;
+        decoded_offset += block.decoded_size;
+        if (block.offset > index_offset
+            || block.encoded_size > index_offset - block.offset)
+            throw std::runtime_error{"corrupt huffman block index"};
+    }
+}
+
+string huffman_blocks::encode(const char* data, size_t size,
+                              size_t block_size, unsigned threads)
+{
+    // block sizes are stored in 32 bits, and a block's character counts
+    // must fit in an int
+    if (block_size == 0 || block_size >= (1u << 31))
+        throw std::invalid_argument{"invalid block size"};
+
+    auto count = (size + block_size - 1) / block_size;
+    vector<string> blocks(count);
+    parallel_for(count, threads, [&](size_t i)
+    {
+        auto begin = i * block_size;
+        blocks[i] = encode_block(data + begin,
+                                 std::min(block_size, size - begin));
+    });
+
+    string out{magic, sizeof(magic)};
+    string index;
+    for (size_t i = 0; i < count; ++i)
+    {
+        append_le(index, out.size(), 8);
+        append_le(index, blocks[i].size(), 4);
+        append_le(index, std::min(block_size, size - i * block_size), 4);
+        out += blocks[i];
+        string{}.swap(blocks[i]);
+    }
+    auto index_offset = out.size();
+    out += index;
+    append_le(out, count, 4);
+    append_le(out, index_offset, 8);
+    return out;
+}
+
+size_t huffman_blocks::num_blocks() const
+{
+    return blocks_.size();
+}
+
+size_t huffman_blocks::decoded_size() const
+{
+    if (blocks_.empty())
+        return 0;
+    return blocks_.back().decoded_offset + blocks_.back().decoded_size;
+}
+
+string huffman_blocks::decode_block(size_t index) const
+{
+    string out(blocks_.at(index).decoded_size, '\0');
+    decode_block(index, &out[0]);
+    return out;
+}
+
+void huffman_blocks::decode_block(size_t index, char* out) const
+{
+    const auto& block = blocks_[index];
+    auto begin = data_ + block.offset;
+    auto end = begin + block.encoded_size;
+
+    auto pos = begin;
+    huffman_tree tree{huffman_tree::parse_code_lengths(pos, end)};
+    tree.decode_chunk(pos, end - pos, out, block.decoded_size);
+}
+
+string huffman_blocks::decode(unsigned threads) const
+{
+    string out(decoded_size(), '\0');
+    parallel_for(blocks_.size(), threads, [&](size_t i)
+    {
+        decode_block(i, &out[blocks_[i].decoded_offset]);
+    });
+    return out;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file huffman_blocks.h
+ * Definition of a container of independently Huffman coded blocks.
+ */
+
+#ifndef HUFFMAN_BLOCKS_H_
+#define HUFFMAN_BLOCKS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "huffman_tree.h"
+
+/**
+ * huffman_blocks: a view of data compressed as a sequence of blocks, each
+ * with its own canonical huffman_tree. Because no block depends on any
+ * other, blocks are encoded and decoded on several threads, and any
+ * single block can be decoded on its own.
+ *
+ * The encoded format is:
+ *  - the magic bytes "HUFB";
+ *  - the blocks: each is its code lengths (as written by
+ *    huffman_tree::append_code_lengths) followed by its encoded data;
+ *  - the index: for each block, its offset, encoded size and decoded
+ *    size;
+ *  - the number of blocks and the offset of the index.
+ *
+ * All integers are little endian: offsets are 64 bits, sizes 32 bits.
+ */
+class huffman_blocks
+{
+  public:
+    /**
+     * Creates a view of encoded data. The data is not copied and must
+     * outlive the view.
+     *
+     * @param data The encoded data, as produced by encode.
+     * @param size The number of bytes of encoded data.
+     */
+    huffman_blocks(const char* data, size_t size);
+
+    /**
+     * Encodes data as independently coded blocks.
+     *
+     * @param data The data to encode.
+     * @param size The number of bytes of data.
+     * @param block_size The number of bytes of data per block, less
+     * than 2^31.
+     * @param threads The number of threads to encode with (0 to use one
+     * per hardware thread).
+     * @return The encoded data.
+     */
+    static std::string encode(const char* data, size_t size,
+                              size_t block_size = default_block_size,
+                              unsigned threads = 0);
+
+    /**
+     * @return The number of blocks.
+     */
+    size_t num_blocks() const;
+
+    /**
+     * @return The total number of bytes of decoded data.
+     */
+    size_t decoded_size() const;
+
+    /**
+     * Decodes a single block.
+     *
+     * @param index The block to decode.
+     * @return The decoded contents of the block.
+     */
+    std::string decode_block(size_t index) const;
+
+    /**
+     * Decodes every block.
+     *
+     * @param threads The number of threads to decode with (0 to use one
+     * per hardware thread).
+     * @return The decoded data.
+     */
+    std::string decode(unsigned threads = 0) const;
+
+    /// Default number of bytes of data per block
+    const static size_t default_block_size = 1 << 20;
+
+  private:
+    /**
+     * Index entry describing one block.
+     */
+    struct block_info
+    {
+        /// Offset of the block's code lengths in the encoded data
+        uint64_t offset;
+        /// Size of the block's code lengths and encoded data
+        uint32_t encoded_size;
+        /// Size of the block once decoded
+        uint32_t decoded_size;
+        /// Offset of the block's contents in the decoded data
+        uint64_t decoded_offset;
+    };
+
+    /**
+     * Decodes a single block into a buffer.
+     *
+     * @param index The block to decode.
+     * @param out Where to write the block; must have room for the
+     * block's decoded size.
+     */
+    void decode_block(size_t index, char* out) const;
+
+    /// The encoded data
+    const char* data_;
+    /// The number of bytes of encoded data
+    size_t size_;
+    /// One entry per block, read from the index
+    std::vector<block_info> blocks_;
+};
+#endif
@@ -0,0 +1,265 @@
+/**
+ * @file huffman_multi_table.cpp
+ * Implementation of a container of data Huffman coded with several trees.
+ */
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+
+#include "bit_io.h"
+#include "byte_histogram.h"
+#include "huffman_multi_table.h"
+
+using namespace std;
+
+namespace
+{
+const char magic[] = {'H', 'U', 'F', 'M'};
+
+/// Size of the header before the trees: magic, decoded and group size
+const size_t header_size = sizeof(magic) + 8 + 4;
+
+/// Number of times the trees are refitted to the groups that pick them
+const int num_passes = 4;
+
+/// Longest code a tree may use, as in bzip2
+const int max_code_length = 20;
+
+void append_le(string& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        out.push_back(static_cast<char>(value >> (8 * i)));
+}
+
+uint64_t read_le(const char* data, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+        value |= uint64_t{static_cast<uint8_t>(data[i])} << (8 * i);
+    return value;
+}
+
+/**
+ * Picks a number of trees for the given number of groups: more trees
+ * only pay for their code lengths on larger inputs. Same thresholds as
+ * bzip2.
+ */
+unsigned default_num_tables(size_t num_groups)
+{
+    if (num_groups < 200)
+        return 2;
+    if (num_groups < 600)
+        return 3;
+    if (num_groups < 1200)
+        return 4;
+    if (num_groups < 2400)
+        return 5;
+    return 6;
+}
+
+/**
+ * Computes the code lengths of each tree from the characters of the
+ * groups that picked it. Every character of the data gets a code in
+ * every tree.
+ */
+vector<std::array<uint8_t, 256>>
+    fit_tables(const char* data, size_t size, size_t group_size,
+               const vector<uint8_t>& selectors,
+               const vector<frequency>& alphabet, unsigned num_tables)
+{
+    vector<std::array<uint64_t, 256>> counts(num_tables);
+    for (auto& c : counts)
+        c.fill(0);
+    for (size_t g = 0; g < selectors.size(); ++g)
+    {
+        auto& table = counts[selectors[g]];
+        auto end = std::min(size, (g + 1) * group_size);
+        for (auto i = g * group_size; i < end; ++i)
+            ++table[static_cast<uint8_t>(data[i])];
+    }
+
+    vector<std::array<uint8_t, 256>> lengths;
+    for (const auto& table : counts)
+    {
+        // one extra occurrence of each character keeps every code present
+        std::array<uint64_t, 256> fitted{};
+        for (const auto& f : alphabet)
+        {
+            auto c = static_cast<uint8_t>(f.character());
+            fitted[c] = table[c] + 1;
+        }
+        byte_histogram::fit_counts(fitted);
+        vector<frequency> frequencies;
+        for (const auto& f : alphabet)
+        {
+            auto count = fitted[static_cast<uint8_t>(f.character())];
+            frequencies.emplace_back(f.character(), static_cast<int>(count));
+        }
+        lengths.push_back(
+            huffman_tree{frequencies, max_code_length}.code_lengths());
+    }
+    return lengths;
+}
+
+/**
+ * Points each group at the tree that codes it in the fewest bits.
+ */
+void pick_tables(const char* data, size_t size, size_t group_size,
+                 const vector<std::array<uint8_t, 256>>& lengths,
+                 vector<uint8_t>& selectors)
+{
+    for (size_t g = 0; g < selectors.size(); ++g)
+    {
+        std::array<uint64_t, huffman_multi_table::max_tables> cost{};
+        auto end = std::min(size, (g + 1) * group_size);
+        for (auto i = g * group_size; i < end; ++i)
+        {
+            auto c = static_cast<uint8_t>(data[i]);
+            for (size_t t = 0; t < lengths.size(); ++t)
+                cost[t] += lengths[t][c];
+        }
+        selectors[g] = static_cast<uint8_t>(
+            std::min_element(cost.begin(), cost.begin() + lengths.size())
+            - cost.begin());
+    }
+}
+}
+
+huffman_multi_table::huffman_multi_table(const char* data, size_t size)
+{
+    if (size < header_size + 1
+        || !std::equal(magic, magic + sizeof(magic), data))
+        throw std::runtime_error{"not a huffman multi-table file"};
+
+    auto pos = data + sizeof(magic);
+    auto end = data + size;
+    decoded_size_ = read_le(pos, 8);
+    group_size_ = read_le(pos + 8, 4);
+    pos += 12;
+    unsigned num_tables = static_cast<uint8_t>(*pos++);
+    if (group_size_ == 0 || num_tables > max_tables
+        || (decoded_size_ > 0 && num_tables == 0))
+        throw std::runtime_error{"corrupt huffman multi-table header"};
+
+    for (unsigned t = 0; t < num_tables; ++t)
+        tables_.emplace_back(huffman_tree::parse_code_lengths(pos, end));
+    bits_ = pos;
+    bits_size_ = end - pos;
+}
+
+string huffman_multi_table::encode(const char* data, size_t size,
+                                   unsigned num_tables, size_t group_size)
+{
+    // group sizes are stored in 32 bits
+    if (group_size == 0 || group_size > std::numeric_limits<uint32_t>::max())
+        throw std::invalid_argument{"invalid group size"};
+    if (num_tables > max_tables)
+        throw std::invalid_argument{"too many tables"};
+
+    string out{magic, sizeof(magic)};
+    append_le(out, size, 8);
+    append_le(out, group_size, 4);
+    if (size == 0)
+    {
+        out.push_back(0);
+        return out;
+    }
+
+    byte_histogram histogram;
+    histogram.add_parallel(data, size);
+    auto alphabet = histogram.frequencies();
+
+    auto num_groups = (size + group_size - 1) / group_size;
+    if (num_tables == 0)
+        num_tables = default_num_tables(num_groups);
+    num_tables = static_cast<unsigned>(
+        std::min<size_t>(num_tables, num_groups));
+
+    // start with each tree fitted to one contiguous run of groups
+    vector<uint8_t> selectors(num_groups);
+    for (size_t g = 0; g < num_groups; ++g)
+        selectors[g] = static_cast<uint8_t>(g * num_tables / num_groups);
+    vector<std::array<uint8_t, 256>> lengths;
+    for (int pass = 0; pass < num_passes; ++pass)
+    {
+        lengths = fit_tables(data, size, group_size, selectors, alphabet,
+                             num_tables);
+        pick_tables(data, size, group_size, lengths, selectors);
+    }
+
+    out.push_back(static_cast<char>(num_tables));
+    vector<huffman_tree> trees;
+    for (const auto& table : lengths)
+    {
+        huffman_tree::append_code_lengths(table, out);
+        trees.emplace_back(table);
+    }
+
+    bit_writer writer{out};
+    // selectors: the position of each in a move-to-front list, in unary
+    std::array<uint8_t, max_tables> order;
+    for (unsigned t = 0; t < max_tables; ++t)
+        order[t] = static_cast<uint8_t>(t);
+    for (const auto& selector : selectors)
+    {
+        int j = std::find(order.begin(), order.end(), selector) - order.begin();
+        writer.write_bits(((uint64_t{1} << j) - 1) << 1, j + 1);
+        std::rotate(order.begin(), order.begin() + j, order.begin() + j + 1);
+    }
+
+    for (size_t g = 0; g < num_groups; ++g)
+    {
+        auto begin = g * group_size;
+        trees[selectors[g]].encode_bits(data + begin,
+                                        std::min(group_size, size - begin),
+                                        writer);
+    }
+    writer.flush();
+    return out;
+}
+
+size_t huffman_multi_table::num_tables() const
+{
+    return tables_.size();
+}
+
+size_t huffman_multi_table::decoded_size() const
+{
+    return decoded_size_;
+}
+
+string huffman_multi_table::decode() const
+{
+    string out(decoded_size_, '\0');
+    if (out.empty())
+        return out;
+
+    bit_reader in{bits_, bits_size_};
+    auto num_groups = (decoded_size_ + group_size_ - 1) / group_size_;
+    vector<uint8_t> selectors(num_groups);
+    std::array<uint8_t, max_tables> order;
+    for (unsigned t = 0; t < max_tables; ++t)
+        order[t] = static_cast<uint8_t>(t);
+    for (auto& selector : selectors)
+    {
+        size_t j = 0;
+        while (in.read_bits(1))
+        {
+            if (++j == tables_.size())
+                throw std::runtime_error{"corrupt huffman selector"};
+        }
+        selector = order[j];
+        std::rotate(order.begin(), order.begin() + j, order.begin() + j + 1);
+    }
+
+    for (size_t g = 0; g < num_groups; ++g)
+    {
+        auto begin = g * group_size_;
+        tables_[selectors[g]].decode_bits(
+            in, &out[begin], std::min<uint64_t>(group_size_,
+                                                decoded_size_ - begin));
+    }
+    return out;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file huffman_multi_table.h
+ * Definition of a container of data Huffman coded with several trees.
+ */
+
+#ifndef HUFFMAN_MULTI_TABLE_H_
+#define HUFFMAN_MULTI_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "huffman_tree.h"
+
+/**
+ * huffman_multi_table: a view of data compressed with several canonical
+ * huffman_trees, in the style of bzip2. The data is split into small
+ * groups of characters and each group is coded with whichever tree codes
+ * it in the fewest bits, so that data whose statistics change from one
+ * part to the next (text mixed with binary, say) is not forced through a
+ * single tree fitted to the average.
+ *
+ * The trees are fitted by alternating two steps a few times: every group
+ * picks its cheapest tree, then every tree is rebuilt from the characters
+ * of the groups that picked it. Each tree gives every character that
+ * appears anywhere in the data a code, so any group can use any tree.
+ *
+ * The encoded format is:
+ *  - the magic bytes "HUFM";
+ *  - the decoded size (64 bits) and the group size (32 bits);
+ *  - the number of trees (a byte), then the code lengths of each tree,
+ *    as written by huffman_tree::append_code_lengths;
+ *  - a bit stream holding the selectors, the tree picked by each group,
+ *    then the codes for every group. Each selector is stored as its
+ *    position in a move-to-front list of the trees, in unary: runs of
+ *    groups picking the same tree cost a single bit per group.
+ *
+ * All integers are little endian.
+ */
+class huffman_multi_table
+{
+  public:
+    /**
+     * Creates a view of encoded data. The data is not copied and must
+     * outlive the view.
+     *
+     * @param data The encoded data, as produced by encode.
+     * @param size The number of bytes of encoded data.
+     */
+    huffman_multi_table(const char* data, size_t size);
+
+    /**
+     * Encodes data with several huffman_trees.
+     *
+     * @param data The data to encode.
+     * @param size The number of bytes of data.
+     * @param num_tables The number of trees to fit, at most max_tables (0
+     * to pick a number based on the size of the data).
+     * @param group_size The number of characters coded by each selector.
+     * @return The encoded data.
+     */
+    static std::string encode(const char* data, size_t size,
+                              unsigned num_tables = 0,
+                              size_t group_size = default_group_size);
+
+    /**
+     * @return The number of trees used.
+     */
+    size_t num_tables() const;
+
+    /**
+     * @return The total number of bytes of decoded data.
+     */
+    size_t decoded_size() const;
+
+    /**
+     * Decodes the data.
+     *
+     * @return The decoded data.
+     */
+    std::string decode() const;
+
+    /// Default number of characters coded by each selector
+    const static size_t default_group_size = 50;
+
+    /// Most trees a file may use
+    const static unsigned max_tables = 6;
+
+  private:
+    /// The trees, rebuilt from their code lengths
+    std::vector<huffman_tree> tables_;
+    /// The number of characters coded by each selector
+    size_t group_size_;
+    /// The number of bytes of decoded data
+    uint64_t decoded_size_;
+    /// Start of the bit stream of selectors and codes
+    const char* bits_;
+    /// The number of bytes in the bit stream
+    size_t bits_size_;
+};
+#endif
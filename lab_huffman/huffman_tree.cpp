@@ -9,31 +9,82 @@
 
 #include <algorithm>
 #include <iostream>
-#include <queue>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
 #include <utility>
 
+#include "byte_histogram.h"
 #include "huffman_tree.h"
 
 using namespace std;
 
+namespace
+{
+/**
+ * Scales frequencies down, as byte_histogram::fit_counts does, if their
+ * total does not fit in an int: the tree is built by adding them up.
+ */
+void fit_frequencies(vector<frequency>& frequencies)
+{
+    uint64_t total = 0;
+    std::array<uint64_t, 256> counts{};
+    for (const auto& f : frequencies)
+    {
+        total += f.count();
+        counts[static_cast<uint8_t>(f.character())] += f.count();
+    }
+    if (total <= static_cast<uint64_t>(std::numeric_limits<int>::max()))
+        return;
+    byte_histogram::fit_counts(counts);
+    for (auto& f : frequencies)
+    {
+        f = frequency{f.character(),
+                      static_cast<int>(counts[static_cast<uint8_t>(
+                          f.character())])};
+    }
+}
+}
+
 huffman_tree::huffman_tree(vector<frequency> frequencies)
 {
+    fit_frequencies(frequencies);
     std::stable_sort(frequencies.begin(), frequencies.end());
     build_tree(frequencies);
-    vector<bool> path;
-    build_map(root_.get(), path);
+    build_map();
+    build_decode_table();
+}
+
+huffman_tree::huffman_tree(vector<frequency> frequencies, int max_code_length)
+    : huffman_tree{frequencies}
+{
+    int longest = 0;
+    for (const auto& code : codes_)
+        longest = std::max(longest, static_cast<int>(code & code_length_mask_));
+    if (longest <= max_code_length)
+        return;
+
+    fit_frequencies(frequencies);
+    std::array<int, 256> counts{};
+    for (const auto& f : frequencies)
+        counts[static_cast<uint8_t>(f.character())] = f.count();
+    assign_canonical_codes(limit_code_lengths(frequencies, max_code_length));
+    build_tree_from_codes(counts);
+    build_decode_table();
 }
 
-huffman_tree::huffman_tree(const huffman_tree& other)
+huffman_tree::huffman_tree(const std::array<uint8_t, 256>& lengths)
 {
-    copy(other);
+    assign_canonical_codes(lengths);
+    build_decode_table();
 }
 
 huffman_tree::huffman_tree(binary_file_reader& bfile)
 {
-    root_ = read_tree(bfile);
-    vector<bool> path;
-    build_map(root_.get(), path);
+    read_tree(bfile);
+    build_map();
+    build_decode_table();
 }
 
 huffman_tree& huffman_tree::operator=(huffman_tree rhs)
@@ -44,212 +95,775 @@ huffman_tree& huffman_tree::operator=(huffman_tree rhs)
 
 void huffman_tree::swap(huffman_tree& other)
 {
+    std::swap(nodes_, other.nodes_);
     std::swap(root_, other.root_);
-    std::swap(bits_map_, other.bits_map_);
+    std::swap(codes_, other.codes_);
+    std::swap(decode_table_, other.decode_table_);
+    std::swap(canonical_, other.canonical_);
+    std::swap(length_count_, other.length_count_);
+    std::swap(first_code_, other.first_code_);
+    std::swap(first_index_, other.first_index_);
+    std::swap(sorted_chars_, other.sorted_chars_);
 }
 
-void huffman_tree::copy(const huffman_tree& rhs)
+void huffman_tree::build_tree(const vector<frequency>& frequencies)
 {
-    root_ = copy(rhs.root_.get());
+    nodes_.clear();
+    root_ = nil_;
+    if (frequencies.empty())
+        return;
+
+    // leaves first: the single queue is [next_single, num_single)
+    auto num_single = static_cast<uint32_t>(frequencies.size());
+    nodes_.reserve(2 * frequencies.size() - 1);
+    for (const auto& f : frequencies)
+        nodes_.emplace_back(f);
+
+    // every internal node is appended as it is made, so the merge queue
+    // is [next_merge, nodes_.size())
+    uint32_t next_single = 0;
+    uint32_t next_merge = num_single;
+    while (nodes_.size() < 2 * frequencies.size() - 1)
+    {
+        auto child1 = remove_smallest(next_single, num_single, next_merge);
+        auto child2 = remove_smallest(next_single, num_single, next_merge);
+        node parent{nodes_[child1].freq.count() + nodes_[child2].freq.count()};
+        parent.left = child1;
+        parent.right = child2;
+        nodes_.push_back(parent);
+    }
+
+    // the last node made is the root
+    root_ = static_cast<uint32_t>(nodes_.size() - 1);
 }
 
-auto huffman_tree::copy(const node* current) -> std::unique_ptr<node>
+void huffman_tree::build_map()
 {
-    if (!current)
-        return nullptr;
-    auto n = std::make_unique<node>(current->freq);
-    n->left = copy(current->left.get());
-    n->right = copy(current->right.get());
-    return n;
+    if (root_ == nil_)
+        return;
+
+    struct visit
+    {
+        uint32_t current;
+        uint64_t path;
+        int depth;
+    };
+    vector<visit> stack{{root_, 0, 0}};
+    while (!stack.empty())
+    {
+        auto v = stack.back();
+        stack.pop_back();
+        const auto& current = nodes_[v.current];
+
+        // leaf node: the path to it is its code
+        if (current.left == nil_ && current.right == nil_)
+        {
+            codes_[static_cast<uint8_t>(current.freq.character())] =
+                (v.path << code_length_bits_) | v.depth;
+            continue;
+        }
+
+        if (v.depth == max_code_length_)
+            throw std::runtime_error{"huffman_tree is too deep"};
+
+        stack.push_back({current.right, (v.path << 1) | 1, v.depth + 1});
+        stack.push_back({current.left, v.path << 1, v.depth + 1});
+    }
 }
 
-void huffman_tree::build_tree(const vector<frequency>& frequencies)
+void huffman_tree::print_in_order() const
 {
-    // queue containing leaf nodes
-    std::queue<std::unique_ptr<node>> single_queue;
-    // queue containing internal nodes
-    std::queue<std::unique_ptr<node>> merge_queue;
+    print_in_order(root_);
+    cout << endl;
+}
 
-	// make nodes and place them in single_queue
-	for (size_t i=0; i<frequencies.size(); ++i) {
-		std::unique_ptr<node> n = std::unique_ptr<node>{new node{frequencies[i]}};
-		single_queue.push(std::move(n));
-	}
-	
-	// build tree
-	while (single_queue.size() + merge_queue.size() != 1) {
+void huffman_tree::print_in_order(uint32_t current) const
+{
+    if (current == nil_)
+        return;
+    const auto& n = nodes_[current];
+    print_in_order(n.left);
+    cout << n.freq.character() << ":" << n.freq.count() << " ";
+    print_in_order(n.right);
+}
 
-		auto child1 = remove_smallest(single_queue, merge_queue);
-		auto child2 = remove_smallest(single_queue, merge_queue);
-		frequency parFreq(child1->freq.count() + child2->freq.count());
-		auto parent = std::unique_ptr<node>{new node{parFreq}};
-		parent->left = std::move(child1);
-		parent->right = std::move(child2);
-		merge_queue.push(std::move(parent));
+uint32_t huffman_tree::remove_smallest(uint32_t& next_single,
+                                       uint32_t num_single,
+                                       uint32_t& next_merge) const
+{
+    bool single_empty = next_single == num_single;
+    bool merge_empty = next_merge == nodes_.size();
+
+    if (single_empty && merge_empty)
+        return nil_;
+    if (merge_empty
+        || (!single_empty && nodes_[next_single].freq.count()
+                                 <= nodes_[next_merge].freq.count()))
+        return next_single++;
+    return next_merge++;
+}
 
-	}
+string huffman_tree::decode_file(binary_file_reader& bfile)
+{
+    string out;
+    // a tree built from frequencies knows exactly how much it encoded
+    if (root_ != nil_)
+        out.reserve(nodes_[root_].freq.count());
+    decode(out, bfile);
+    return out;
+}
 
-	// only one left as root
-	if (single_queue.size() == 1) {
-		root_ = std::move(single_queue.front());
-		single_queue.pop();
-	}
-	if (merge_queue.size() == 1) {
-		root_ = std::move(merge_queue.front());
-		merge_queue.pop();
-	}
+void huffman_tree::build_decode_table()
+{
+    decode_table_.clear();
+    if (root_ == nil_)
+    {
+        if (!canonical_)
+            return;
+        // no nodes: fill the table straight from the canonical codes
+        decode_table_.resize(1 << decode_table_bits_, {nil_, '\0', 0});
+        for (int c = 0; c < 256; ++c)
+        {
+            int len = codes_[c] & code_length_mask_;
+            if (len == 0 || len > decode_table_bits_)
+                continue;
+            auto code = static_cast<uint32_t>(codes_[c] >> code_length_bits_);
+            auto first = code << (decode_table_bits_ - len);
+            auto last = first + (1u << (decode_table_bits_ - len));
+            for (auto i = first; i < last; ++i)
+                decode_table_[i] = {nil_, static_cast<char>(c),
+                                    static_cast<uint8_t>(len)};
+        }
+        return;
+    }
 
+    // a lone leaf has an empty code, so there is nothing to decode
+    if (nodes_[root_].left == nil_ && nodes_[root_].right == nil_)
+        return;
+    decode_table_.resize(1 << decode_table_bits_, {nil_, '\0', 0});
+    fill_decode_table(root_, 0, 0);
 }
 
-void huffman_tree::build_map(const node* current, vector<bool>& path)
+void huffman_tree::fill_decode_table(uint32_t current, int depth,
+                                     uint32_t prefix)
 {
-    // Base case: leaf node.
-    if (!current->left && !current->right)
+    if (current == nil_)
+        return;
+    const auto& n = nodes_[current];
+    if (n.left == nil_ && n.right == nil_)
+    {
+        // every index that starts with this code decodes to this leaf
+        auto first = prefix << (decode_table_bits_ - depth);
+        auto last = first + (1u << (decode_table_bits_ - depth));
+        for (auto i = first; i < last; ++i)
+            decode_table_[i] = {current, n.freq.character(),
+                                static_cast<uint8_t>(depth)};
+        return;
+    }
+
+    if (depth == decode_table_bits_)
     {
-        bits_map_[current->freq.character()] = path;
+        decode_table_[prefix] = {current, '\0', 0};
         return;
     }
 
-    // Move left
-    path.push_back(false);
-    build_map(current->left.get(), path);
-    path.pop_back();
+    fill_decode_table(n.left, depth + 1, prefix << 1);
+    fill_decode_table(n.right, depth + 1, (prefix << 1) | 1);
+}
+
+void huffman_tree::assign_canonical_codes(const std::array<uint8_t, 256>& lengths)
+{
+    length_count_.fill(0);
+    for (const auto& len : lengths)
+    {
+        if (len > max_code_length_)
+            throw std::runtime_error{"code length too long"};
+        if (len)
+            ++length_count_[len];
+    }
+
+    // codes of each length start right after the (shifted) last code of
+    // the previous length
+    uint64_t code = 0;
+    uint16_t index = 0;
+    first_code_[0] = 0;
+    first_index_[0] = 0;
+    for (int len = 1; len <= max_code_length_; ++len)
+    {
+        first_code_[len] = code;
+        first_index_[len] = index;
+        if (length_count_[len] > (uint64_t{1} << len) - code)
+            throw std::runtime_error{"invalid code lengths"};
+        code = (code + length_count_[len]) << 1;
+        index += length_count_[len];
+    }
 
-    // Move right
-    path.push_back(true);
-    build_map(current->right.get(), path);
-    path.pop_back();
+    auto next = first_index_;
+    for (int c = 0; c < 256; ++c)
+    {
+        if (lengths[c])
+            sorted_chars_[next[lengths[c]]++] = static_cast<char>(c);
+    }
+
+    codes_.fill(0);
+    for (int len = 1; len <= max_code_length_; ++len)
+    {
+        for (int i = 0; i < length_count_[len]; ++i)
+        {
+            auto c = static_cast<uint8_t>(sorted_chars_[first_index_[len] + i]);
+            codes_[c] = ((first_code_[len] + i) << code_length_bits_) | len;
+        }
+    }
+    canonical_ = true;
 }
 
-void huffman_tree::print_in_order() const
+std::array<uint8_t, 256>
+    huffman_tree::limit_code_lengths(const vector<frequency>& frequencies,
+                                     int max_length)
 {
-    print_in_order(root_.get());
-    cout << endl;
+    std::array<uint8_t, 256> lengths{};
+    auto n = frequencies.size();
+    if (n == 1)
+    {
+        lengths[static_cast<uint8_t>(frequencies[0].character())] = 1;
+        return lengths;
+    }
+    if (max_length < 1 || max_length > max_code_length_
+        || n > (uint64_t{1} << max_length))
+        throw std::invalid_argument{"invalid code length limit"};
+
+    vector<size_t> leaves(n);
+    for (size_t i = 0; i < n; ++i)
+        leaves[i] = i;
+    std::stable_sort(leaves.begin(), leaves.end(), [&](size_t a, size_t b)
+    {
+        return frequencies[a].count() < frequencies[b].count();
+    });
+
+    // An item is either a leaf or a package of the two items at
+    // first and first + 1 on the previous level. Every level is the
+    // leaves merged with the packages of adjacent pairs of the previous
+    // level, sorted by weight.
+    struct item
+    {
+        uint64_t weight;
+        int leaf;
+        size_t first;
+    };
+    vector<vector<item>> levels(max_length);
+    for (int l = 0; l < max_length; ++l)
+    {
+        vector<item> packages;
+        if (l > 0)
+        {
+            const auto& prev = levels[l - 1];
+            for (size_t i = 0; i + 1 < prev.size(); i += 2)
+                packages.push_back({prev[i].weight + prev[i + 1].weight, -1, i});
+        }
+
+        auto& level = levels[l];
+        size_t li = 0;
+        size_t pi = 0;
+        while (li < n || pi < packages.size())
+        {
+            if (pi == packages.size()
+                || (li < n && static_cast<uint64_t>(
+                                  frequencies[leaves[li]].count())
+                                  <= packages[pi].weight))
+            {
+                auto leaf = leaves[li++];
+                level.push_back({static_cast<uint64_t>(
+                                     frequencies[leaf].count()),
+                                 static_cast<int>(leaf), 0});
+            }
+            else
+            {
+                level.push_back(packages[pi++]);
+            }
+        }
+    }
+
+    // each leaf's code length is the number of times it appears in the
+    // 2n - 2 lightest items of the last level
+    vector<std::pair<int, size_t>> stack;
+    for (size_t i = 0; i < 2 * n - 2; ++i)
+        stack.emplace_back(max_length - 1, i);
+    while (!stack.empty())
+    {
+        auto l = stack.back().first;
+        const auto& it = levels[l][stack.back().second];
+        stack.pop_back();
+        if (it.leaf >= 0)
+        {
+            ++lengths[static_cast<uint8_t>(frequencies[it.leaf].character())];
+        }
+        else
+        {
+            stack.emplace_back(l - 1, it.first);
+            stack.emplace_back(l - 1, it.first + 1);
+        }
+    }
+    return lengths;
 }
 
-void huffman_tree::print_in_order(const node* current) const
+void huffman_tree::build_tree_from_codes(const std::array<int, 256>& counts)
 {
-    if (!current)
+    auto num_chars = 256 - std::count(counts.begin(), counts.end(), 0);
+    nodes_.clear();
+    nodes_.reserve(std::max<ptrdiff_t>(2 * num_chars - 1, 1));
+    nodes_.emplace_back(0);
+    root_ = 0;
+    for (int c = 0; c < 256; ++c)
+    {
+        int len = codes_[c] & code_length_mask_;
+        if (len == 0)
+            continue;
+        auto code = codes_[c] >> code_length_bits_;
+        uint32_t current = root_;
+        for (int b = len - 1; b >= 0; --b)
+        {
+            nodes_[current].freq =
+                frequency{nodes_[current].freq.count() + counts[c]};
+            auto child = ((code >> b) & 1) ? nodes_[current].right
+                                           : nodes_[current].left;
+            if (child == nil_)
+            {
+                child = static_cast<uint32_t>(nodes_.size());
+                nodes_.emplace_back(0);
+                if ((code >> b) & 1)
+                    nodes_[current].right = child;
+                else
+                    nodes_[current].left = child;
+            }
+            current = child;
+        }
+        nodes_[current].freq = frequency{static_cast<char>(c), counts[c]};
+    }
+}
+
+void huffman_tree::canonicalize()
+{
+    if (root_ == nil_)
         return;
-    print_in_order(current->left.get());
-    cout << current->freq.character() << ":" << current->freq.count() << " ";
-    print_in_order(current->right.get());
-}
-
-auto huffman_tree::remove_smallest(
-    std::queue<std::unique_ptr<node>>& single_queue,
-    std::queue<std::unique_ptr<node>>& merge_queue) -> std::unique_ptr<node>
-{
-	std::unique_ptr<node> smallest = nullptr;
-
-	if (single_queue.empty() && merge_queue.empty())
-		return smallest;
-	else if (single_queue.empty()) {
-		smallest = std::move(merge_queue.front());
-		merge_queue.pop();
-	}
-	else if (merge_queue.empty()) {
-		smallest = std::move(single_queue.front());
-		single_queue.pop();
-	}
-	
-	else if (single_queue.front()->freq.count() <= merge_queue.front()->freq.count()) {
-		smallest = std::move(single_queue.front());
-		single_queue.pop();
-	} 
-	else if (single_queue.front()->freq.count() > merge_queue.front()->freq.count()) {
-		smallest = std::move(merge_queue.front());
-		merge_queue.pop();
-	}
-	return smallest;
+
+    std::array<int, 256> counts{};
+    for (const auto& n : nodes_)
+    {
+        if (n.left == nil_ && n.right == nil_)
+            counts[static_cast<uint8_t>(n.freq.character())] = n.freq.count();
+    }
+
+    assign_canonical_codes(code_lengths());
+    build_tree_from_codes(counts);
+    build_decode_table();
 }
 
-string huffman_tree::decode_file(binary_file_reader& bfile)
+std::array<uint8_t, 256> huffman_tree::code_lengths() const
+{
+    std::array<uint8_t, 256> lengths{};
+    for (int c = 0; c < 256; ++c)
+        lengths[c] = codes_[c] & code_length_mask_;
+
+    // a tree of one leaf gets a one bit code, so it can be decoded
+    if (root_ != nil_ && nodes_[root_].left == nil_
+        && nodes_[root_].right == nil_)
+        lengths[static_cast<uint8_t>(nodes_[root_].freq.character())] = 1;
+    return lengths;
+}
+
+namespace
+{
+/**
+ * Reads code lengths in the format of append_code_lengths, a byte at a
+ * time from next_byte, which returns -1 at the end of the input.
+ */
+template <class NextByte>
+std::array<uint8_t, 256> read_lengths(NextByte next_byte)
+{
+    auto next = [&]()
+    {
+        int b = next_byte();
+        if (b < 0)
+            throw std::runtime_error{"truncated code lengths"};
+        return static_cast<uint8_t>(b);
+    };
+
+    std::array<uint8_t, 256> lengths{};
+    int num_chars = next();
+    num_chars |= next() << 8;
+    if (num_chars > 256)
+        throw std::runtime_error{"invalid code lengths"};
+    for (int i = 0; i < num_chars; ++i)
+    {
+        auto c = next();
+        lengths[c] = next();
+    }
+    return lengths;
+}
+}
+
+void huffman_tree::append_code_lengths(const std::array<uint8_t, 256>& lengths,
+                                       string& out)
+{
+    auto num_chars = 256 - std::count(lengths.begin(), lengths.end(), 0);
+    out.push_back(static_cast<char>(num_chars & 0xff));
+    out.push_back(static_cast<char>(num_chars >> 8));
+    for (int c = 0; c < 256; ++c)
+    {
+        if (!lengths[c])
+            continue;
+        out.push_back(static_cast<char>(c));
+        out.push_back(static_cast<char>(lengths[c]));
+    }
+}
+
+std::array<uint8_t, 256> huffman_tree::parse_code_lengths(const char*& pos,
+                                                          const char* end)
 {
-    stringstream ss;
-    decode(ss, bfile);
-    return ss.str();
+    return read_lengths([&]()
+                        { return pos == end ? -1 : static_cast<uint8_t>(*pos++); });
 }
 
-void huffman_tree::decode(stringstream& ss, binary_file_reader& bfile)
+std::array<uint8_t, 256> huffman_tree::read_code_lengths(std::istream& in)
 {
-    auto current = root_.get();
+    return read_lengths([&]()
+                        {
+                            auto c = in.get();
+                            return c == std::char_traits<char>::eof() ? -1 : c;
+                        });
+}
+
+void huffman_tree::write_code_lengths(binary_file_writer& bfile)
+{
+    if (!canonical_)
+        throw std::logic_error{"code lengths only describe canonical trees"};
+
+    string header;
+    append_code_lengths(code_lengths(), header);
+    for (auto c : header)
+        bfile.write_byte(static_cast<uint8_t>(c));
+}
+
+std::array<uint8_t, 256>
+    huffman_tree::read_code_lengths(binary_file_reader& bfile)
+{
+    return read_lengths([&]() -> int
+                        {
+                            if (!bfile.has_bits())
+                                return -1;
+                            return static_cast<uint8_t>(bfile.next_byte());
+                        });
+}
+
+bool huffman_tree::decode_long(const decode_entry& entry, uint64_t prefix,
+                               bit_reader& in, char& c) const
+{
+    if (entry.next != nil_)
+    {
+        // follow the tree from where the table left off
+        auto current = entry.next;
+        while (nodes_[current].left != nil_ || nodes_[current].right != nil_)
+        {
+            if (in.bits_left() == 0)
+                return false;
+            current = in.read_bits(1) ? nodes_[current].right
+                                      : nodes_[current].left;
+            if (current == nil_)
+                return false;
+        }
+        c = nodes_[current].freq.character();
+        return true;
+    }
+
+    // no nodes: extend the code a bit at a time until it is a valid
+    // canonical code of its length
+    auto code = prefix;
+    for (int len = decode_table_bits_ + 1; len <= max_code_length_; ++len)
+    {
+        if (in.bits_left() == 0)
+            return false;
+        code = (code << 1) | in.read_bits(1);
+        // unsigned wraparound rejects codes below the first of this length
+        if (code - first_code_[len] < length_count_[len])
+        {
+            c = sorted_chars_[first_index_[len] + (code - first_code_[len])];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool huffman_tree::decode_one(bit_reader& in, char& c) const
+{
+    // near the end of the input the probe is padded with zeros; the
+    // entry is only used if its code fits in the bits actually left
+    auto prefix = in.peek_bits(decode_table_bits_);
+    const auto& entry = decode_table_[prefix];
+    if (entry.length != 0)
+    {
+        if (entry.length > in.bits_left())
+            return false;
+        in.skip_bits(entry.length);
+        c = entry.character;
+        return true;
+    }
+
+    // long code: continue from where the table left off
+    if (in.bits_left() < decode_table_bits_)
+        return false;
+    in.skip_bits(decode_table_bits_);
+    return decode_long(entry, prefix, in, c);
+}
+
+void huffman_tree::decode(string& out, binary_file_reader& bfile)
+{
+    if (decode_table_.empty())
+        return;
+
+    // gather the file's bits, a byte at a time
+    string bytes;
+    int last_byte_bits = 8;
     while (bfile.has_bits())
     {
-		auto nextb = bfile.next_bit();
-		if (nextb == 0)
-			current = current->left.get();
-		if (nextb == 1)
-			current = current->right.get();
-		if (!(current->left) && !(current->right)) {
-			ss << current->freq.character();
-			current = root_.get();
-		}
+        uint8_t byte = 0;
+        for (last_byte_bits = 0; last_byte_bits < 8 && bfile.has_bits();
+             ++last_byte_bits)
+            byte = (byte << 1) | bfile.next_bit();
+        bytes.push_back(static_cast<char>(byte << (8 - last_byte_bits)));
     }
+
+    bit_reader in{bytes.data(), bytes.size(), last_byte_bits};
+    char c;
+    while (decode_one(in, c))
+        out.push_back(c);
 }
 
-void huffman_tree::write(const string& data, binary_file_writer& bfile)
+void huffman_tree::encode_bits(const char* data, size_t size,
+                               bit_writer& out) const
 {
-    for (const auto& c : data)
-        write(c, bfile);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto code = code_for_char(data[i]);
+        out.write_bits(code >> code_length_bits_, code & code_length_mask_);
+    }
 }
 
-void huffman_tree::write(char c, binary_file_writer& bfile)
+void huffman_tree::encode_chunk(const char* data, size_t size,
+                                string& out) const
 {
-    vector<bool> bits = bits_for_char(c);
-    for (const auto& b : bits)
-        bfile.write_bit(b);
+    bit_writer writer{out};
+    encode_bits(data, size, writer);
+    // pad the last byte with zeros
+    writer.flush();
 }
 
-vector<bool> huffman_tree::bits_for_char(char c)
+void huffman_tree::decode_chunk(const char* data, size_t size, char* out,
+                                size_t num_chars) const
 {
-    return bits_map_[c];
+    bit_reader in{data, size};
+    decode_bits(in, out, num_chars);
 }
 
-void huffman_tree::write_tree(binary_file_writer& bfile)
+void huffman_tree::decode_bits(bit_reader& in, char* out,
+                               size_t num_chars) const
+{
+    if (decode_table_.empty())
+    {
+        // a lone leaf has an empty code: every character is that leaf
+        if (num_chars > 0 && root_ == nil_)
+            throw std::logic_error{"huffman_tree is empty"};
+        std::fill(out, out + num_chars,
+                  root_ != nil_ ? nodes_[root_].freq.character() : 0);
+        return;
+    }
+
+    for (size_t n = 0; n < num_chars; ++n)
+    {
+        if (!decode_one(in, out[n]))
+            throw std::runtime_error{"invalid or truncated huffman data"};
+    }
+}
+
+namespace
+{
+void write_u32(std::ostream& out, uint32_t value)
+{
+    char bytes[4];
+    for (int i = 0; i < 4; ++i)
+        bytes[i] = static_cast<char>(value >> (8 * i));
+    out.write(bytes, 4);
+}
+
+uint32_t read_u32(std::istream& in)
+{
+    char bytes[4];
+    if (!in.read(bytes, 4))
+        throw std::runtime_error{"unexpected end of huffman stream"};
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+        value |= uint32_t{static_cast<uint8_t>(bytes[i])} << (8 * i);
+    return value;
+}
+}
+
+vector<frequency> huffman_tree::stream_frequencies(std::istream& in,
+                                                   size_t chunk_size)
+{
+    if (chunk_size == 0)
+        throw std::invalid_argument{"invalid chunk size"};
+    auto start = in.tellg();
+    byte_histogram histogram;
+    // smaller chunks would be counted on a single thread
+    vector<char> chunk(std::max(chunk_size, byte_histogram::parallel_size()));
+    while (in.read(chunk.data(), chunk.size()) || in.gcount() > 0)
+        histogram.add_parallel(chunk.data(), in.gcount());
+    in.clear();
+    in.seekg(start);
+    return histogram.frequencies();
+}
+
+void huffman_tree::write_stream(std::istream& in, std::ostream& out,
+                                size_t chunk_size)
 {
-    write_tree(root_.get(), bfile);
+    // encoded chunk sizes must fit in 32 bits even at 57 bits per char
+    if (chunk_size == 0 || chunk_size > (1 << 28))
+        throw std::invalid_argument{"invalid chunk size"};
+    if (!canonical_)
+        canonicalize();
+
+    // header: the code lengths
+    string header;
+    append_code_lengths(code_lengths(), header);
+    out.write(header.data(), header.size());
+
+    // each chunk: its decoded size, its encoded size, then the data
+    vector<char> chunk(chunk_size);
+    string encoded;
+    while (in.read(chunk.data(), chunk.size()) || in.gcount() > 0)
+    {
+        auto size = static_cast<size_t>(in.gcount());
+        encoded.clear();
+        encode_chunk(chunk.data(), size, encoded);
+        write_u32(out, size);
+        write_u32(out, encoded.size());
+        out.write(encoded.data(), encoded.size());
+    }
+    write_u32(out, 0);
 }
 
-void huffman_tree::write_tree(node* current, binary_file_writer& bfile)
+void huffman_tree::decode_stream(std::istream& in, std::ostream& out)
 {
-	if (!(current->right) && !(current->left)) {
-		bfile.write_bit(true);
-		bfile.write_byte(current->freq.character());
-		return;
-	} else {
-		bfile.write_bit(false);
-		write_tree(current->left.get(), bfile);
-		write_tree(current->right.get(), bfile);
-	}
+    auto lengths = read_code_lengths(in);
+    huffman_tree tree{lengths};
 
+    vector<char> encoded;
+    vector<char> decoded;
+    while (auto size = read_u32(in))
+    {
+        encoded.resize(read_u32(in));
+        if (!in.read(encoded.data(), encoded.size()))
+            throw std::runtime_error{"unexpected end of huffman stream"};
+        decoded.resize(size);
+        tree.decode_chunk(encoded.data(), encoded.size(), decoded.data(),
+                          size);
+        out.write(decoded.data(), size);
+    }
 }
 
-auto huffman_tree::read_tree(binary_file_reader& bfile) -> std::unique_ptr<node>
+void huffman_tree::write(const string& data, binary_file_writer& bfile)
 {
-	std::unique_ptr<node> ret = nullptr;
-	bool nbi;
-	uint8_t nby;
-	char* ch;
-	
-	if (bfile.has_bits()) {
+    string encoded;
+    bit_writer writer{encoded};
+    encode_bits(data.data(), data.size(), writer);
+    auto num_bits = writer.bits_written();
+    writer.flush();
+
+    // whole bytes first, then the bits of the last, partial byte.
+    // write_byte emits the most significant bit first, just like
+    // consecutive write_bit calls would
+    for (size_t i = 0; i < num_bits / 8; ++i)
+        bfile.write_byte(static_cast<uint8_t>(encoded[i]));
+    auto last = static_cast<uint8_t>(encoded.empty() ? 0 : encoded.back());
+    for (size_t b = 0; b < num_bits % 8; ++b)
+        bfile.write_bit((last >> (7 - b)) & 1);
+}
 
-		nbi = bfile.next_bit();	
-		if (nbi == 1) {
-			nby = bfile.next_byte();
-			ch = (char*)&nby;
-			frequency f{*ch, 0};
-			auto n = std::unique_ptr<node>{new node{f}};
-			return std::move(n);
-		} else {
-			ret = std::unique_ptr<node>{new node{0}};
-			ret->left = read_tree(bfile);
-			ret->right = read_tree(bfile);
-		}
-	} 
-	
-	return std::move(ret);
+void huffman_tree::write(char c, binary_file_writer& bfile)
+{
+    auto code = code_for_char(c);
+    for (int b = (code & code_length_mask_) - 1; b >= 0; --b)
+        bfile.write_bit((code >> (code_length_bits_ + b)) & 1);
+}
 
+uint64_t huffman_tree::code_for_char(char c) const
+{
+    return codes_[static_cast<uint8_t>(c)];
+}
+
+void huffman_tree::write_tree(binary_file_writer& bfile)
+{
+    if (root_ == nil_)
+        throw std::logic_error{"tree built from code lengths has no nodes"};
+
+    // preorder: a 1 bit and the character for a leaf, a 0 bit then both
+    // subtrees for an internal node
+    vector<uint32_t> stack{root_};
+    while (!stack.empty())
+    {
+        const auto& current = nodes_[stack.back()];
+        stack.pop_back();
+        if (current.left == nil_ && current.right == nil_)
+        {
+            bfile.write_bit(true);
+            bfile.write_byte(current.freq.character());
+        }
+        else
+        {
+            bfile.write_bit(false);
+            stack.push_back(current.right);
+            stack.push_back(current.left);
+        }
+    }
+}
+
+void huffman_tree::read_tree(binary_file_reader& bfile)
+{
+    nodes_.clear();
+    root_ = nil_;
+    if (!bfile.has_bits())
+        return;
+
+    // internal nodes still waiting for a child; each node read is the
+    // left child of the top one if it has none yet, else its right
+    vector<uint32_t> parents;
+    do
+    {
+        if (!bfile.has_bits())
+            throw std::runtime_error{"truncated huffman tree"};
+        auto current = static_cast<uint32_t>(nodes_.size());
+        bool leaf = bfile.next_bit();
+        if (leaf)
+            nodes_.emplace_back(
+                frequency{static_cast<char>(bfile.next_byte()), 0});
+        else
+            nodes_.emplace_back(0);
+
+        if (parents.empty())
+        {
+            root_ = current;
+        }
+        else if (nodes_[parents.back()].left == nil_)
+        {
+            nodes_[parents.back()].left = current;
+        }
+        else
+        {
+            nodes_[parents.back()].right = current;
+            parents.pop_back();
+        }
+        if (!leaf)
+            parents.push_back(current);
+    } while (!parents.empty());
 }
 
 // class for generic printing
@@ -259,15 +873,16 @@ class huffman_tree_node_descriptor
     : public GenericNodeDescriptor<huffman_tree_node_descriptor<node>>
 {
   public:
-    huffman_tree_node_descriptor(const node* root) : subroot(root)
+    huffman_tree_node_descriptor(const vector<node>& nodes, uint32_t root)
+        : nodes(&nodes), subroot(root)
     {/* nothing */
     }
 
     string key() const
     {
         std::stringstream ss;
-        char ch = subroot->freq.character();
-        int freq = subroot->freq.count();
+        char ch = (*nodes)[subroot].freq.character();
+        int freq = (*nodes)[subroot].freq.count();
 
         // print the sum of the two child frequencies
         if (ch == '\0')
@@ -286,32 +901,47 @@ class huffman_tree_node_descriptor
 
     bool isNull() const
     {
-        return !subroot;
+        // nil indices are past the end of the nodes
+        return subroot >= nodes->size();
     }
     huffman_tree_node_descriptor left() const
     {
-        return huffman_tree_node_descriptor(subroot->left.get());
+        return huffman_tree_node_descriptor(*nodes, (*nodes)[subroot].left);
     }
     huffman_tree_node_descriptor right() const
     {
-        return huffman_tree_node_descriptor(subroot->right.get());
+        return huffman_tree_node_descriptor(*nodes, (*nodes)[subroot].right);
     }
 
   private:
-    const node* subroot;
+    const vector<node>* nodes;
+    uint32_t subroot;
 };
 
-int huffman_tree::height(const node* subroot) const
+int huffman_tree::height() const
 {
-    if (!subroot)
+    if (root_ == nil_)
         return -1;
-    return 1 +
-           std::max(height(subroot->left.get()), height(subroot->right.get()));
+
+    int h = 0;
+    vector<std::pair<uint32_t, int>> stack{{root_, 0}};
+    while (!stack.empty())
+    {
+        auto current = stack.back().first;
+        auto depth = stack.back().second;
+        stack.pop_back();
+        h = std::max(h, depth);
+        if (nodes_[current].left != nil_)
+            stack.emplace_back(nodes_[current].left, depth + 1);
+        if (nodes_[current].right != nil_)
+            stack.emplace_back(nodes_[current].right, depth + 1);
+    }
+    return h;
 }
 
 void huffman_tree::print(std::ostream& out) const
 {
-    int h = height(root_.get());
+    int h = height();
     if (h > max_print_height_)
     {
         out << "Tree is too big to print. Try with a small file (e.g. "
@@ -319,5 +949,5 @@ void huffman_tree::print(std::ostream& out) const
         return;
     }
 
-    printTree(huffman_tree_node_descriptor<node>(root_.get()), out);
+    printTree(huffman_tree_node_descriptor<node>(nodes_, root_), out);
 }
@@ -9,16 +9,19 @@
 #ifndef HUFFMAN_TREE_H_
 #define HUFFMAN_TREE_H_
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <vector>
-#include <queue>
 #include <utility>
 #include <sstream>
-#include <map>
 #include <string>
+#include <istream>
 #include <ostream>
 
 #include "printtree.h"
+#include "bit_io.h"
 #include "frequency.h"
 #include "binary_file_reader.h"
 #include "binary_file_writer.h"
@@ -40,6 +43,20 @@ class huffman_tree
      */
     huffman_tree(std::vector<frequency> frequencies);
 
+    /**
+     * Creates a huffman_tree from a given set of frequency objects, with
+     * no code longer than a given length. If the plain Huffman code would
+     * exceed the limit, the optimal length-limited code lengths are
+     * computed with the package-merge algorithm and the tree is rebuilt
+     * as a canonical tree with those lengths. Codes of at most 10 bits
+     * are always decoded with a single lookup table probe.
+     *
+     * @param frequencies The frequency objects for this tree.
+     * @param max_code_length The longest code allowed. There must be room
+     * for every character: 2^max_code_length >= frequencies.size().
+     */
+    huffman_tree(std::vector<frequency> frequencies, int max_code_length);
+
     /**
      * Creates a huffman_tree from a binary file that has been written
      * to compress the tree information.
@@ -49,12 +66,23 @@ class huffman_tree
      */
     huffman_tree(binary_file_reader& bfile);
 
+    /**
+     * Creates a canonical huffman_tree from the code length of every
+     * character (0 for characters that do not appear). Codes are
+     * assigned by counting, and the decoding tables are built directly
+     * from the lengths without allocating any tree nodes.
+     *
+     * @param lengths The code length of each character, indexed by its
+     * unsigned byte value.
+     */
+    huffman_tree(const std::array<uint8_t, 256>& lengths);
+
     /**
      * Copy constructor for Huffman Trees.
      *
      * @param other The huffman_tree to copy.
      */
-    huffman_tree(const huffman_tree& other);
+    huffman_tree(const huffman_tree& other) = default;
 
     /**
      * Move constructor for Huffman Trees.
@@ -115,6 +143,152 @@ class huffman_tree
      */
     void write_tree(binary_file_writer& bfile);
 
+    /**
+     * Replaces this tree's codes with canonical Huffman codes of the same
+     * lengths: shorter codes come first and codes of equal length are
+     * ordered by character. A canonical tree is fully described by its
+     * code lengths, so it can be stored with write_code_lengths.
+     */
+    void canonicalize();
+
+    /**
+     * @return The code length of each character in this tree, indexed by
+     * its unsigned byte value (0 for characters not in the tree).
+     */
+    std::array<uint8_t, 256> code_lengths() const;
+
+    /**
+     * Writes the code lengths of a canonical tree to the file, in the
+     * format of append_code_lengths. This is much smaller than the output
+     * of write_tree.
+     *
+     * @param bfile The binary file to be written to.
+     */
+    void write_code_lengths(binary_file_writer& bfile);
+
+    /**
+     * Reads code lengths written by write_code_lengths, suitable for
+     * constructing a canonical huffman_tree.
+     *
+     * @param bfile The binary file to read from.
+     * @return The code length of each character.
+     */
+    static std::array<uint8_t, 256>
+        read_code_lengths(binary_file_reader& bfile);
+
+    /**
+     * Appends code lengths to a buffer in the header format shared by
+     * every encoding of this lab: the number of characters that have a
+     * code, as two little endian bytes, then a character byte and a
+     * length byte for each. An empty alphabet is a count of zero.
+     *
+     * @param lengths The code length of each character.
+     * @param out The buffer to append to.
+     */
+    static void append_code_lengths(const std::array<uint8_t, 256>& lengths,
+                                    std::string& out);
+
+    /**
+     * Parses code lengths written by append_code_lengths.
+     *
+     * @param pos Where the code lengths start; moved past their end.
+     * @param end The end of the buffer.
+     * @return The code length of each character.
+     * @throws std::runtime_error If the buffer ends before the lengths.
+     */
+    static std::array<uint8_t, 256> parse_code_lengths(const char*& pos,
+                                                       const char* end);
+
+    /**
+     * Reads code lengths written by append_code_lengths from a stream.
+     *
+     * @param in The stream to read from.
+     * @return The code length of each character.
+     * @throws std::runtime_error If the stream ends before the lengths.
+     */
+    static std::array<uint8_t, 256> read_code_lengths(std::istream& in);
+
+    /**
+     * Encodes a buffer of characters into whole bytes, padding the last
+     * byte with zero bits.
+     *
+     * @param data The characters to encode.
+     * @param size The number of characters to encode.
+     * @param out The string to append the encoded bytes to.
+     */
+    void encode_chunk(const char* data, size_t size, std::string& out) const;
+
+    /**
+     * Decodes a buffer written by encode_chunk.
+     *
+     * @param data The encoded bytes.
+     * @param size The number of encoded bytes.
+     * @param out Where to write the decoded characters; must have room
+     * for num_chars characters.
+     * @param num_chars The number of characters to decode.
+     */
+    void decode_chunk(const char* data, size_t size, char* out,
+                      size_t num_chars) const;
+
+    /**
+     * Encodes a buffer of characters to a bit_writer, so that the codes
+     * can be mixed with other data or with the output of other trees.
+     *
+     * @param data The characters to encode.
+     * @param size The number of characters to encode.
+     * @param out Where to write the codes.
+     */
+    void encode_bits(const char* data, size_t size, bit_writer& out) const;
+
+    /**
+     * Decodes characters written by encode_bits.
+     *
+     * @param in Where to read the codes from.
+     * @param out Where to write the decoded characters; must have room
+     * for num_chars characters.
+     * @param num_chars The number of characters to decode.
+     */
+    void decode_bits(bit_reader& in, char* out, size_t num_chars) const;
+
+    /**
+     * Encodes everything left in a stream, one chunk at a time, so that
+     * memory use is bounded by the chunk size rather than the input size.
+     * The output starts with the code lengths of the tree, which is made
+     * canonical first if it is not already.
+     *
+     * @param in The stream to encode.
+     * @param out The stream to write the encoded data to.
+     * @param chunk_size The number of characters to encode at a time.
+     */
+    void write_stream(std::istream& in, std::ostream& out,
+                      size_t chunk_size = default_chunk_size);
+
+    /**
+     * Decodes a stream written by write_stream, one chunk at a time.
+     *
+     * @param in The stream to decode.
+     * @param out The stream to write the decoded data to.
+     */
+    static void decode_stream(std::istream& in, std::ostream& out);
+
+    /**
+     * Counts the characters left in a seekable stream, one chunk at a
+     * time, then seeks back to where it started so the stream can be
+     * passed to write_stream.
+     *
+     * @param in The stream to count.
+     * @param chunk_size The number of characters to read at a time,
+     * raised to byte_histogram::parallel_size() if smaller so that every
+     * chunk is counted on all threads.
+     * @return The frequency of every character in the stream.
+     */
+    static std::vector<frequency>
+        stream_frequencies(std::istream& in,
+                           size_t chunk_size = default_chunk_size);
+
+    /// Default number of characters per chunk for the stream functions
+    const static size_t default_chunk_size = 1 << 20;
+
     /**
      * Prints each element in the tree in an in-order traversal.
      */
@@ -127,9 +301,13 @@ class huffman_tree
     void print(std::ostream& out) const;
 
   private:
+    /// Index standing in for a missing node
+    const static uint32_t nil_ = std::numeric_limits<uint32_t>::max();
+
     /**
      * node class: internal representation of the Huffman tree.
-     * Done using linked memory.
+     * All nodes live in one array, nodes_, and refer to their children
+     * by index into it.
      *
      * @author Chase Geigle
      * @date Summer 2012
@@ -139,10 +317,10 @@ class huffman_tree
       public:
         /// Data for this node: contains a character and a count.
         frequency freq;
-        /// Left child of this node
-        std::unique_ptr<node> left;
-        /// Right child of this node
-        std::unique_ptr<node> right;
+        /// Index of the left child of this node, or nil_
+        uint32_t left;
+        /// Index of the right child of this node, or nil_
+        uint32_t right;
 
         /**
          * Builds a new node with the given frequency as data.
@@ -150,7 +328,7 @@ class huffman_tree
          * @param theFreq The frequency to build this node
          * with.
          */
-        node(frequency theFreq) : freq{theFreq}
+        node(frequency theFreq) : freq{theFreq}, left{nil_}, right{nil_}
         {
             // nothing
         }
@@ -161,36 +339,32 @@ class huffman_tree
          *
          * @param frequency The frequency for this internal node.
          */
-        node(int frequency) : freq{frequency}
+        node(int frequency) : freq{frequency}, left{nil_}, right{nil_}
         {
             // nothing
         }
     };
 
     /**
-     * Private helper function that copies another huffman_tree.
-     *
-     * @param other The huffman_tree to be copied.
-     */
-    void copy(const huffman_tree& other);
-
-    /**
-     * Recursive, private helper function that copies a given subtree
-     * of another huffman_tree.
-     *
-     * @param current The root of the subtree in the other huffman_tree
-     * to be copied.
-     * @return A pointer to the root of the new, copied subtree.
+     * Number of bits the decoder looks up at once. Every code at most
+     * this long is decoded with a single table probe.
      */
-    std::unique_ptr<node> copy(const node* current);
+    const static int decode_table_bits_ = 10;
 
     /**
-     * Recursive, private helper function that frees all memory
-     * associated with a subtree of the huffman_tree.
-     *
-     * @param current The root of the subtree to free data from.
+     * An entry of the decoding table, indexed by the next
+     * decode_table_bits_ bits of input. If the code starting with those
+     * bits fits in the table, length is its length and character its
+     * decoded value; otherwise length is 0 and next is the index of the
+     * node reached after following all decode_table_bits_ bits (nil_ if
+     * the tree was built from code lengths and has no nodes).
      */
-    void clear(node* current);
+    struct decode_entry
+    {
+        uint32_t next;
+        char character;
+        uint8_t length;
+    };
 
     /**
      * Helper function used by the constructor to build a huffman_tree
@@ -198,8 +372,13 @@ class huffman_tree
      * represents a character and how often it appears in the data to
      * be encoded.
      *
+     * The n leaves take the first n slots of nodes_, in sorted order,
+     * and each internal node is appended as it is made. Internal nodes
+     * are made in order of increasing count, so both ranges of nodes_
+     * serve as the two queues of the linear time construction.
+     *
      * @param frequencies The set of frequency objects to build the
-     * tree with.
+     * tree with, sorted by count.
      */
     void build_tree(const std::vector<frequency>& frequencies);
 
@@ -208,74 +387,129 @@ class huffman_tree
      * from a compressed version of the tree written in a binary file.
      *
      * @param bfile The binary file we are reading.
-     * @return A pointer to the root of the subtree built.
      */
-    std::unique_ptr<node> read_tree(binary_file_reader& bfile);
+    void read_tree(binary_file_reader& bfile);
 
     /**
-     * Recursive helper function used by the constructor to build a map
-     * of characters to their encoded values based on the tree
-     * structure built.
-     *
-     * @param current The current node we are visiting.
-     * @param path The current path we have taken to get to this node.
-     * Used to store the encoded value for the characters of the tree.
+     * Helper function used by the constructor to build the table of
+     * characters to their encoded values based on the tree structure
+     * built.
      */
-    void build_map(const node* current, std::vector<bool>& path);
+    void build_map();
 
     /**
      * Private helper for printing a tree in order.
-     * @param current The current subroot
+     * @param current The index of the current subroot
      */
-    void print_in_order(const node* current) const;
+    void print_in_order(uint32_t current) const;
 
     /**
-     * Helper function: finds the smallest element on the two queues
-     * and removes it. In the event that there is a tie, it should remove
-     * the front of the **single_queue**.
+     * Helper function: finds the smallest node at the front of the two
+     * queues and removes it. In the event that there is a tie, it should
+     * remove the front of the **single queue**.
      *
-     * @param single_queue The first queue to inspect.
-     * @param merge_queue The second queue to inspect.
-     * @return A pointer to the smallest node that used to be at
-     * the front of one of the queues.
+     * @param next_single The index of the front of the queue of leaves.
+     * @param num_single The number of leaves: the end of their queue.
+     * @param next_merge The index of the front of the queue of internal
+     * nodes, whose end is the end of nodes_.
+     * @return The index of the smallest node that used to be at the
+     * front of one of the queues, or nil_ if both are empty.
      */
-    std::unique_ptr<node>
-        remove_smallest(std::queue<std::unique_ptr<node>>& single_queue,
-                        std::queue<std::unique_ptr<node>>& merge_queue);
+    uint32_t remove_smallest(uint32_t& next_single, uint32_t num_single,
+                             uint32_t& next_merge) const;
 
     /**
      * Determines the encoded value for a given character.
      *
      * @param c The character to find the encoded value for.
-     * @return The encoded value for that character.
+     * @return The encoded value for that character, packed as
+     * (code << code_length_bits_) | length.
      */
-    std::vector<bool> bits_for_char(char c);
+    uint64_t code_for_char(char c) const;
 
     /**
-     * Helper function that recursively decodes a file by traversing
-     * the tree based on the bits read.
+     * Helper function that decodes a file: its bits are gathered into
+     * memory, then decoded a word at a time by decode_one.
      *
-     * @param ss The stringstream being used to build the decoded
-     * output string.
+     * @param out The string being used to build the decoded output.
      * @param bfile The binary file we are decoding.
      */
-    void decode(std::stringstream& ss, binary_file_reader& bfile);
+    void decode(std::string& out, binary_file_reader& bfile);
 
     /**
-     * Helper function to write the tree out to a binary file in a
-     * compressed way.
+     * Decodes a single character with one lookup table probe, falling
+     * back to decode_long for codes longer than the table is wide.
      *
-     * @param current The root of the subtree we are currently writing.
-     * @param bfile The fiel we are writing to.
+     * @param in The bits to decode.
+     * @param c Set to the decoded character.
+     * @return Whether a complete code was read.
      */
-    void write_tree(node* current, binary_file_writer& bfile);
+    bool decode_one(bit_reader& in, char& c) const;
+
+    /**
+     * Helper function used by the constructors to build the decoding
+     * lookup table, from the tree structure if there is one and from
+     * the canonical codes otherwise.
+     */
+    void build_decode_table();
+
+    /**
+     * Assigns canonical codes for the given code lengths, filling
+     * codes_ and the tables used to decode codes too long for the
+     * decoding lookup table.
+     *
+     * @param lengths The code length of each character.
+     */
+    void assign_canonical_codes(const std::array<uint8_t, 256>& lengths);
+
+    /**
+     * Computes optimal code lengths no longer than a limit using the
+     * package-merge algorithm.
+     *
+     * @param frequencies The frequency objects to compute lengths for.
+     * @param max_length The longest code length allowed.
+     * @return The code length of each character.
+     */
+    static std::array<uint8_t, 256>
+        limit_code_lengths(const std::vector<frequency>& frequencies,
+                           int max_length);
+
+    /**
+     * Rebuilds the tree structure to match the codes in codes_.
+     *
+     * @param counts The count to give each leaf, indexed by character.
+     */
+    void build_tree_from_codes(const std::array<int, 256>& counts);
+
+    /**
+     * Decodes a code longer than the decoding lookup table, by
+     * traversing the tree if there is one and by counting otherwise.
+     *
+     * @param entry The decoding table entry for the first
+     * decode_table_bits_ bits of the code.
+     * @param prefix The first decode_table_bits_ bits of the code.
+     * @param in The rest of the bits, following the prefix.
+     * @param c Set to the decoded character.
+     * @return Whether a complete code was read.
+     */
+    bool decode_long(const decode_entry& entry, uint64_t prefix,
+                     bit_reader& in, char& c) const;
+
+    /**
+     * Recursive helper for build_decode_table: fills the table entries
+     * whose index begins with the path to the given node.
+     *
+     * @param current The index of the current node we are visiting.
+     * @param depth The depth of current (the length of the path).
+     * @param prefix The path to current, as bits of an integer.
+     */
+    void fill_decode_table(uint32_t current, int depth, uint32_t prefix);
 
     /**
      * Private helper to get the height of the huffman_tree.
-     * @param subroot Where we're currently at.
      * @return the height of the tree
      */
-    int height(const node* subroot) const;
+    int height() const;
 
     /**
      * Maximum height of trees to enable printing for
@@ -283,9 +517,37 @@ class huffman_tree
      */
     const static int max_print_height_ = 9;
 
-    /// Root of the tree
-    std::unique_ptr<node> root_;
-    /// Standard map that maps characters to their encoded values
-    std::map<char, std::vector<bool>> bits_map_;
+    /**
+     * Longest code length supported. A code and its length are packed
+     * into one 64-bit integer, and the encoder must be able to append a
+     * whole code to a bit buffer that still holds up to 7 bits.
+     */
+    const static int max_code_length_ = 57;
+
+    /// Number of low bits of a packed code that hold its length
+    const static int code_length_bits_ = 6;
+
+    /// Mask selecting the length of a packed code
+    const static int code_length_mask_ = (1 << code_length_bits_) - 1;
+
+    /// Every node of the tree
+    std::vector<node> nodes_;
+    /// Index of the root of the tree, or nil_ if it has no nodes
+    uint32_t root_ = nil_;
+    /// Lookup table used by decode, built from the tree
+    std::vector<decode_entry> decode_table_;
+    /// Packed encoded value of each character, indexed by its unsigned
+    /// byte value; 0 for characters not in the tree
+    std::array<uint64_t, 256> codes_{};
+    /// Whether codes_ holds canonical codes
+    bool canonical_ = false;
+    /// Number of canonical codes of each length
+    std::array<uint16_t, max_code_length_ + 1> length_count_;
+    /// First canonical code of each length
+    std::array<uint64_t, max_code_length_ + 1> first_code_;
+    /// Position in sorted_chars_ of the first code of each length
+    std::array<uint16_t, max_code_length_ + 1> first_index_;
+    /// Characters in canonical code order
+    std::array<char, 256> sorted_chars_;
 };
 #endif
@@ -3,11 +3,54 @@
  * Implementation of kd_tree class.
  */
 
+#include <utility>
+
 #include "kdtree.h"
-#include <cmath>
 
 using namespace std;
 
+namespace detail
+{
+/**
+ * Sums the squared differences of the coordinates of two points from
+ * index I up to Dim, in the points' own scalar type. The recursion is
+ * resolved at compile time, so the sum is straight line code with no
+ * loop or call left, which the compiler can also vectorize for larger
+ * Dim.
+ */
+template <int I, int Dim>
+struct squared_distance_kernel
+{
+	template <class Point>
+	static auto sum(const Point& a, const Point& b) -> decltype(a[0] - b[0])
+	{
+		auto d = a[I] - b[I];
+		return d * d + squared_distance_kernel<I + 1, Dim>::sum(a, b);
+	}
+};
+
+template <int Dim>
+struct squared_distance_kernel<Dim, Dim>
+{
+	template <class Point>
+	static auto sum(const Point&, const Point&)
+		-> decltype(std::declval<const Point&>()[0] - std::declval<const Point&>()[0])
+	{
+		return 0;
+	}
+};
+
+/**
+ * Returns the squared Euclidean distance between two points.
+ */
+template <int Dim>
+auto squared_distance(const point<Dim>& a, const point<Dim>& b)
+	-> decltype(a[0] - b[0])
+{
+	return squared_distance_kernel<0, Dim>::sum(a, b);
+}
+}
+
 /**
  * Determines if point a is smaller than point b in a given dimension d.
  * If there is a tie, break it with point::operator<().
@@ -36,13 +79,8 @@ bool kd_tree<Dim>::should_replace(const point<Dim>& target,
                                  const point<Dim>& current_best,
                                  const point<Dim>& potential) const
 {
-	int potDist = 0;
-	int curDist = 0;
-
-	for (int i=0; i<Dim; ++i) {
-		potDist += pow((potential[i] - target[i]), 2);
-		curDist += pow((current_best[i] - target[i]), 2);
-	}
+	auto potDist = detail::squared_distance(potential, target);
+	auto curDist = detail::squared_distance(current_best, target);
 
 	if (potDist < curDist) return true;
 	else if (potDist == curDist && potential < current_best) return true;
@@ -177,54 +215,30 @@ point<Dim> kd_tree<Dim>::find_nearest_neighbor(const point<Dim>& query) const
 template <int Dim>
 point<Dim> kd_tree<Dim>::find_nn(int idx, const point<Dim>& target, int dim) const
 {
-	point<Dim> child;
-	point<Dim> ret;
-	point<Dim> traverse;
-	bool left;
-	bool right;
-
-	if (target[dim] < points[idx][dim]) {
-			if (left_child[idx] == points.size()) {
-				return points[idx];
-			}
-			child = find_nn(left_child[idx], target, (dim+1) % Dim);
-			left = true;
-			right = false;
-	} else {
-		if (right_child[idx] == points.size()) {
-			return points[idx];
-		}
-			child = find_nn(right_child[idx], target, (dim+1) % Dim);
-			right = true;
-			left = false;
+	const int none = points.size();
+	int near = left_child[idx];
+	int far = right_child[idx];
+	if (!(target[dim] < points[idx][dim]))
+		std::swap(near, far);
+
+	point<Dim> ret = points[idx];
+	if (near != none) {
+		point<Dim> child = find_nn(near, target, (dim+1) % Dim);
+		if (should_replace(target, ret, child))
+			ret = child;
 	}
 
-	if (should_replace(target, points[idx], child)) {
-		ret = child;
-	}
-	else {
-		ret = points[idx];
+	// the other side can only hold a point as close as the best so far if
+	// the splitting plane is that close
+	auto planeDiff = target[dim] - points[idx][dim];
+	if (far != none
+		&& planeDiff * planeDiff <= detail::squared_distance(ret, target)) {
+		point<Dim> traverse = find_nn(far, target, (dim+1) % Dim);
+		if (should_replace(target, ret, traverse))
+			ret = traverse;
 	}
 
-
-	if ((pow(target[dim]-points[idx][dim], 2) < distance(ret, target))
-		|| ((pow(target[dim]-points[idx][dim], 2) == distance(ret, target))
-			&& (points[idx] < ret))) {
-
-		if (left && right_child[idx] != points.size()) {
-			traverse = find_nn(right_child[idx], target, (dim+1) % Dim);
-			if (should_replace(target, ret, traverse))
-				ret = traverse;
-		}
-		else if (right && left_child[idx] != points.size()) {
-			traverse = find_nn(left_child[idx], target, (dim+1) % Dim);
-			if (should_replace(target, ret, traverse))
-				ret = traverse;
-		}
-
-
 	return ret;
-
 }
 
 /**
@@ -233,8 +247,5 @@ point<Dim> kd_tree<Dim>::find_nn(int idx, const point<Dim>& target, int dim) con
 template <int Dim>
 int kd_tree<Dim>::distance(const point<Dim>& pt1, const point<Dim>& pt2) const
 {
-	int sum = 0;
-	for (int i=0; i<Dim; i++)
-		sum += pow(pt1[i]-pt2[i], 2);
-	return sum;
+	return detail::squared_distance(pt1, pt2);
 }
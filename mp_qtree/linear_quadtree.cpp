@@ -0,0 +1,209 @@
+/**
+ * @file linear_quadtree.cpp
+ * linear_quadtree class implementation.
+ */
+
+#include "linear_quadtree.h"
+#include "pixel_math.h"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+using namespace std;
+
+namespace cs225
+{
+
+namespace
+{
+/* Spreads the low 32 bits of v out to the even bits of the result. */
+uint64_t spread_bits (uint64_t v)
+{
+	v &= 0xffffffff;
+	v = (v | (v << 16)) & 0x0000ffff0000ffff;
+	v = (v | (v << 8)) & 0x00ff00ff00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0f;
+	v = (v | (v << 2)) & 0x3333333333333333;
+	v = (v | (v << 1)) & 0x5555555555555555;
+	return v;
+}
+
+/* Morton code of (x, y): x in the even bits, y in the odd bits, so that
+ * each pair of bits picks one of the four quadrants in child order. */
+uint64_t morton (uint64_t x, uint64_t y)
+{
+	return spread_bits(x) | (spread_bits(y) << 1);
+}
+}
+
+linear_quadtree::linear_quadtree () : depth_{0}, resolution_{0}
+{
+	// nothing
+}
+
+linear_quadtree::linear_quadtree (const epng::png &source, uint64_t resolution)
+	: depth_{0}, resolution_{resolution}
+{
+	if (resolution == 0 || (resolution & (resolution - 1)))
+		throw std::invalid_argument{"resolution must be a power of two"};
+	if (resolution > source.width() || resolution > source.height())
+		throw std::out_of_range{"resolution is larger than the image"};
+	while ((uint64_t{1} << depth_) < resolution)
+		++depth_;
+
+	elements_.resize(level_offset(depth_ + 1));
+	pruned_.assign(level_offset(depth_), 0);
+
+	// the bottom level holds the pixels, in Z-order
+	auto leaves = elements_.data() + level_offset(depth_);
+	for (uint64_t y=0; y<resolution; y++) {
+		for (uint64_t x=0; x<resolution; x++)
+			leaves[morton(x, y)] = *source(x, y);
+	}
+
+	// every other node averages its four children, which come after it
+	for (size_t i = level_offset(depth_); i-- > 0; ) {
+		const epng::rgba_pixel* c = &elements_[4*i + 1];
+		elements_[i] = average_pixels(c[0], c[1], c[2], c[3]);
+	}
+
+	// the leaves below a node are a contiguous run of the bottom level, so
+	// each tolerance is measured once, over a single slice of the pixels
+	tol_.resize(level_offset(depth_));
+	for (int level = 0; level < depth_; level++) {
+		size_t span = size_t{1} << (2 * (depth_ - level));
+		size_t first = level_offset(level);
+		for (size_t i = first; i < level_offset(level + 1); i++)
+			tol_[i] = max_pixel_diff(leaves + (i - first) * span, span, elements_[i]);
+	}
+}
+
+size_t linear_quadtree::level_offset (int level)
+{
+	// 1 + 4 + ... + 4^(level - 1)
+	return ((size_t{1} << (2 * level)) - 1) / 3;
+}
+
+bool linear_quadtree::is_leaf (size_t i, int level) const
+{
+	return level == depth_ || pruned_[i];
+}
+
+uint64_t linear_quadtree::resolution () const
+{
+	return resolution_;
+}
+
+const epng::rgba_pixel & linear_quadtree::operator() (uint64_t x, uint64_t y) const
+{
+	if (resolution_ == 0) throw std::runtime_error{"quadtree is empty"};
+	if ((x >= resolution_) || (y >= resolution_)) throw std::out_of_range{"(x,y) is out of range"};
+
+	// the ancestor of the pixel on each level is found by dropping the
+	// low bits of its Morton code
+	uint64_t code = morton(x, y);
+	for (int level = 0; ; level++) {
+		size_t i = level_offset(level) + (code >> (2 * (depth_ - level)));
+		if (is_leaf(i, level))
+			return elements_[i];
+	}
+}
+
+epng::png linear_quadtree::decompress () const
+{
+	if (resolution_ == 0) throw std::runtime_error{"empty tree"};
+
+	epng::png canvas(resolution_, resolution_);
+	struct square {
+		size_t i;
+		int level;
+		uint64_t x;
+		uint64_t y;
+	};
+	std::array<square, 3 * 64 + 1> stack;
+	size_t top = 0;
+	stack[top++] = {0, 0, 0, 0};
+
+	while (top > 0) {
+		square sq = stack[--top];
+		uint64_t res = resolution_ >> sq.level;
+		if (is_leaf(sq.i, sq.level)) {
+			for (uint64_t j=0; j<res; j++)
+				std::fill_n(canvas(sq.x, sq.y + j), res, elements_[sq.i]);
+			continue;
+		}
+
+		uint64_t d = res/2;
+		size_t child = 4*sq.i + 1;
+		stack[top++] = {child + 3, sq.level + 1, sq.x + d, sq.y + d};
+		stack[top++] = {child + 2, sq.level + 1, sq.x, sq.y + d};
+		stack[top++] = {child + 1, sq.level + 1, sq.x + d, sq.y};
+		stack[top++] = {child, sq.level + 1, sq.x, sq.y};
+	}
+	return canvas;
+}
+
+void linear_quadtree::prune (uint32_t tolerance)
+{
+	if (resolution_ == 0) return;
+
+	bool changed = false;
+	std::vector<std::pair<size_t, int>> stack{{0, 0}};
+	while (!stack.empty()) {
+		size_t i = stack.back().first;
+		int level = stack.back().second;
+		stack.pop_back();
+		if (is_leaf(i, level)) continue;
+
+		if (tol_[i] <= tolerance) {
+			pruned_[i] = 1;
+			tol_[i] = 0;
+			changed = true;
+			continue;
+		}
+		for (size_t k=1; k<=4; k++)
+			stack.emplace_back(4*i + k, level + 1);
+	}
+
+	// pruning replaces leaves, so the remaining nodes' cached tolerances
+	// have to be measured again against the new ones
+	if (changed) {
+		std::vector<epng::rgba_pixel> leaves;
+		refresh_tolerance(0, 0, leaves);
+	}
+}
+
+void linear_quadtree::refresh_tolerance (size_t i, int level, std::vector<epng::rgba_pixel> &leaves)
+{
+	if (is_leaf(i, level)) {
+		leaves.push_back(elements_[i]);
+		return;
+	}
+
+	size_t first = leaves.size();
+	for (size_t k=1; k<=4; k++)
+		refresh_tolerance(4*i + k, level + 1, leaves);
+	tol_[i] = max_pixel_diff(leaves.data() + first, leaves.size() - first, elements_[i]);
+}
+
+uint64_t linear_quadtree::pruned_size (uint32_t tolerance) const
+{
+	if (resolution_ == 0) return 0;
+
+	uint64_t leaves = 0;
+	std::vector<std::pair<size_t, int>> stack{{0, 0}};
+	while (!stack.empty()) {
+		size_t i = stack.back().first;
+		int level = stack.back().second;
+		stack.pop_back();
+		if (is_leaf(i, level) || tol_[i] <= tolerance) {
+			leaves++;
+			continue;
+		}
+		for (size_t k=1; k<=4; k++)
+			stack.emplace_back(4*i + k, level + 1);
+	}
+	return leaves;
+}
+
+}
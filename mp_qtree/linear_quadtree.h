@@ -0,0 +1,102 @@
+/**
+ * @file linear_quadtree.h
+ * linear_quadtree class definition.
+ */
+
+#ifndef LINEAR_QUADTREE_H_
+#define LINEAR_QUADTREE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "epng.h"
+
+namespace cs225
+{
+
+/**
+ * A quadtree stored without pointers. The nodes of each level are laid
+ * out in Z-order (by the Morton code of their position: the bits of x
+ * and y interleaved), one level after another, so a node's children are
+ * implicit: those of node i are 4i + 1 to 4i + 4, in northwest,
+ * northeast, southwest, southeast order. A node only stores its color
+ * and, above the bottom level, the tolerance at which it would be
+ * pruned; the nodes of any square region are contiguous in each level.
+ *
+ * Pruning marks nodes as leaves rather than freeing their descendants,
+ * which stay in place but are never visited.
+ */
+class linear_quadtree
+{
+  public:
+	/* Produces an empty linear_quadtree, which represents no image. */
+	linear_quadtree ();
+
+	/* Builds a linear_quadtree representing the upper-left d by d block of
+	 * the source image.
+	 *
+	 * Parameters
+	 * source	The source image to base this tree on
+	 * resolution	The width and height of the block; must be a power of two
+	 * 				no larger than the width and height of source
+	 * */
+	linear_quadtree (const epng::png &source, uint64_t resolution);
+
+	/* Gets the pixel at (x, y) in the image the tree represents: the color
+	 * of the leaf whose square holds that pixel. Throws std::out_of_range if
+	 * (x, y) is outside of the image, and std::runtime_error if the tree is
+	 * empty.
+	 * */
+	const epng::rgba_pixel & operator() (uint64_t x, uint64_t y) const;
+
+	/* Returns the image the tree represents. Throws std::runtime_error if
+	 * the tree is empty.
+	 * */
+	epng::png decompress () const;
+
+	/* Prunes the tree exactly like quadtree::prune: every node none of
+	 * whose leaves differs from its color by more than tolerance becomes
+	 * a leaf.
+	 * */
+	void prune (uint32_t tolerance);
+
+	/* Returns how many leaves the tree would have after prune(tolerance).
+	 * */
+	uint64_t pruned_size (uint32_t tolerance) const;
+
+	/* Returns the width and height of the image the tree represents. */
+	uint64_t resolution () const;
+
+  private:
+	/* Returns the index of the first node of a level. */
+	static size_t level_offset (int level);
+
+	/* Returns whether node i, on the given level, is a leaf. */
+	bool is_leaf (size_t i, int level) const;
+
+	/* Recomputes the cached tolerance of every internal node below node
+	 * i, on the given level, from its current leaves, appending the colors
+	 * of those leaves to leaves. */
+	void refresh_tolerance (size_t i, int level, std::vector<epng::rgba_pixel> &leaves);
+
+	/* Color of every node, one level after another */
+	std::vector<epng::rgba_pixel> elements_;
+
+	/* Whether each node above the bottom level has been pruned into a
+	 * leaf (nodes on the bottom level are always leaves) */
+	std::vector<uint8_t> pruned_;
+
+	/* For each node above the bottom level, the largest difference between
+	 * its color and any of the leaves below it: the smallest tolerance at
+	 * which it would be pruned (0 once it is a leaf) */
+	std::vector<uint32_t> tol_;
+
+	/* Number of levels below the root: resolution_ is 2^depth_ */
+	int depth_;
+
+	/* Width and height of the image, or 0 if the tree is empty */
+	uint64_t resolution_;
+};
+}
+
+#endif
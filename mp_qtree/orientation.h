@@ -0,0 +1,156 @@
+/**
+ * @file orientation.h
+ * Rotations and flips of an image, applied lazily as a change of
+ * coordinates.
+ */
+
+#ifndef ORIENTATION_H_
+#define ORIENTATION_H_
+
+#include <cstdint>
+#include <utility>
+#include "epng.h"
+
+namespace cs225
+{
+
+/* The transforms that can be applied to an image. Rotations are
+ * clockwise. */
+enum class transform
+{
+	rotate_90,
+	rotate_180,
+	rotate_270,
+	flip_horizontal, // mirror left to right
+	flip_vertical    // mirror top to bottom
+};
+
+/**
+ * How an image is shown relative to how it is stored: any combination of
+ * rotations and flips. A pixel (x, y) of the shown image is found in the
+ * stored one by swapping x and y if transpose is set, then mirroring x
+ * if flip_x is set and y if flip_y is set.
+ */
+struct orientation
+{
+	/* A block of pixels, x0 <= x < x1 and y0 <= y < y1 */
+	struct rect
+	{
+		uint64_t x0;
+		uint64_t y0;
+		uint64_t x1;
+		uint64_t y1;
+	};
+
+	bool transpose = false;
+	bool flip_x = false;
+	bool flip_y = false;
+
+	/* The orientation of an image after applying t to the stored one. */
+	static orientation of (transform t)
+	{
+		switch (t) {
+			case transform::rotate_90: return {true, false, true};
+			case transform::rotate_180: return {false, true, true};
+			case transform::rotate_270: return {true, true, false};
+			case transform::flip_horizontal: return {false, true, false};
+			default: return {false, false, true};
+		}
+	}
+
+	/* The orientation of an image shown this way once t is applied to it. */
+	orientation then (transform t) const
+	{
+		// first the coordinates of the new image go through t's change, then
+		// through this one's; a swap moves t's flips to the other axis
+		orientation next = of(t);
+		if (transpose)
+			std::swap(next.flip_x, next.flip_y);
+		return {transpose != next.transpose, flip_x != next.flip_x, flip_y != next.flip_y};
+	}
+
+	bool identity () const
+	{
+		return !transpose && !flip_x && !flip_y;
+	}
+
+	/* Packs the orientation into the low three bits of an integer. */
+	unsigned bits () const
+	{
+		return unsigned(transpose) | (unsigned(flip_x) << 1) | (unsigned(flip_y) << 2);
+	}
+
+	static orientation from_bits (unsigned bits)
+	{
+		return {(bits & 1) != 0, (bits & 2) != 0, (bits & 4) != 0};
+	}
+
+	/* The width of the shown image, for a stored one of width by height. */
+	uint64_t shown_width (uint64_t width, uint64_t height) const
+	{
+		return transpose ? height : width;
+	}
+
+	uint64_t shown_height (uint64_t width, uint64_t height) const
+	{
+		return transpose ? width : height;
+	}
+
+	/* Maps a pixel of the shown image to the stored width by height one. */
+	void to_stored (uint64_t &x, uint64_t &y, uint64_t width, uint64_t height) const
+	{
+		if (transpose)
+			std::swap(x, y);
+		if (flip_x)
+			x = width - 1 - x;
+		if (flip_y)
+			y = height - 1 - y;
+	}
+
+	/* Maps a block of the shown image to the stored width by height one. */
+	rect to_stored (rect r, uint64_t width, uint64_t height) const
+	{
+		if (transpose)
+			r = {r.y0, r.x0, r.y1, r.x1};
+		return mirror(r, width, height);
+	}
+
+	/* Maps a block of the stored width by height image to the shown one. */
+	rect to_shown (rect r, uint64_t width, uint64_t height) const
+	{
+		r = mirror(r, width, height);
+		if (transpose)
+			r = {r.y0, r.x0, r.y1, r.x1};
+		return r;
+	}
+
+	/* Returns the stored image, shown this way. */
+	epng::png apply (const epng::png &stored) const
+	{
+		uint64_t width = stored.width();
+		uint64_t height = stored.height();
+		epng::png shown(shown_width(width, height), shown_height(width, height));
+		for (uint64_t y=0; y<shown.height(); y++) {
+			for (uint64_t x=0; x<shown.width(); x++) {
+				uint64_t sx = x;
+				uint64_t sy = y;
+				to_stored(sx, sy, width, height);
+				*shown(x, y) = *stored(sx, sy);
+			}
+		}
+		return shown;
+	}
+
+  private:
+	rect mirror (rect r, uint64_t width, uint64_t height) const
+	{
+		if (flip_x)
+			r = {width - r.x1, r.y0, width - r.x0, r.y1};
+		if (flip_y)
+			r = {r.x0, height - r.y1, r.x1, height - r.y0};
+		return r;
+	}
+};
+}
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @file pixel_math.h
+ * Integer color arithmetic shared by the quadtrees.
+ */
+
+#ifndef PIXEL_MATH_H_
+#define PIXEL_MATH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "epng.h"
+
+namespace cs225
+{
+
+/* The difference between the colors of two pixels: the squared distance
+ * between their red, green and blue channels. */
+inline uint32_t pixel_diff (const epng::rgba_pixel &a, const epng::rgba_pixel &b)
+{
+	int red = a.red - b.red;
+	int green = a.green - b.green;
+	int blue = a.blue - b.blue;
+	return red*red + green*green + blue*blue;
+}
+
+/* Returns the largest pixel_diff between color and any of count
+ * contiguous pixels. The loop has no branches, so that the compiler can
+ * run it over several pixels per instruction. */
+inline uint32_t max_pixel_diff (const epng::rgba_pixel *pixels, size_t count, const epng::rgba_pixel &color)
+{
+	uint32_t max = 0;
+	for (size_t i=0; i<count; i++) {
+		uint32_t diff = pixel_diff(pixels[i], color);
+		max = diff > max ? diff : max;
+	}
+	return max;
+}
+
+/* Returns the four channels of a pixel packed into a word, red in the
+ * low byte and alpha in the high one. */
+inline uint32_t pack_pixel (const epng::rgba_pixel &pixel)
+{
+	return uint32_t(pixel.red) | (uint32_t(pixel.green) << 8)
+		| (uint32_t(pixel.blue) << 16) | (uint32_t(pixel.alpha) << 24);
+}
+
+inline epng::rgba_pixel unpack_pixel (uint32_t packed)
+{
+	epng::rgba_pixel pixel;
+	pixel.red = packed & 0xff;
+	pixel.green = (packed >> 8) & 0xff;
+	pixel.blue = (packed >> 16) & 0xff;
+	pixel.alpha = packed >> 24;
+	return pixel;
+}
+
+/* Averages four pixels, truncating each channel, with the channels in the
+ * 16 bit lanes of two words: the even bytes of the packed pixels in one
+ * and the odd ones in the other, so that each sum has room to carry. Any
+ * order of the bytes in a word works the same. */
+inline epng::rgba_pixel average_pixels (const epng::rgba_pixel &a, const epng::rgba_pixel &b,
+		const epng::rgba_pixel &c, const epng::rgba_pixel &d)
+{
+	const uint32_t even = 0x00ff00ff;
+	uint32_t pa = pack_pixel(a), pb = pack_pixel(b), pc = pack_pixel(c), pd = pack_pixel(d);
+	uint32_t low = (pa & even) + (pb & even) + (pc & even) + (pd & even);
+	uint32_t high = ((pa >> 8) & even) + ((pb >> 8) & even)
+		+ ((pc >> 8) & even) + ((pd >> 8) & even);
+	return unpack_pixel(((low >> 2) & even) | (((high >> 2) & even) << 8));
+}
+
+/* Averages two pixels in the same way. */
+inline epng::rgba_pixel average_pixels (const epng::rgba_pixel &a, const epng::rgba_pixel &b)
+{
+	const uint32_t even = 0x00ff00ff;
+	uint32_t pa = pack_pixel(a), pb = pack_pixel(b);
+	uint32_t low = (pa & even) + (pb & even);
+	uint32_t high = ((pa >> 8) & even) + ((pb >> 8) & even);
+	return unpack_pixel(((low >> 1) & even) | (((high >> 1) & even) << 8));
+}
+}
+
+#endif
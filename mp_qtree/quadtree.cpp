@@ -6,7 +6,14 @@
  */
 
 #include "quadtree.h"
-#include <cmath>
+#include "quadtree_io.h"
+#include "pixel_math.h"
+#include <algorithm>
+#include <array>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <thread>
 
 using namespace std;
 
@@ -26,10 +33,22 @@ quadtree::quadtree (const epng::png &source, uint64_t resolution)
 	build_tree(source, resolution);
 }
 
+quadtree::quadtree (const epng::png &source)
+{
+	cout << "quadtree::quadtree (const epng::png &source)" << endl;
+	root_ = nullptr;
+	build_tree(source);
+}
+
 quadtree::quadtree (const quadtree &other)
 {
 	cout << "quadtree::quadtree (const quadtree &other)" << endl;
 	root_ = copy(other.root_.get());
+	width_ = other.width_;
+	height_ = other.height_;
+	orientation_ = other.orientation_;
+	thresholds_ = other.thresholds_;
+	kept_leaves_ = other.kept_leaves_;
 }
 
 quadtree::quadtree (quadtree &&other)
@@ -46,6 +65,7 @@ auto quadtree::copy (node *  subroot) -> std::unique_ptr<node>
 		return nullptr;
 	
 	auto ret = std::make_unique<node>(subroot->res, subroot->element);
+	ret->tol = subroot->tol;
 	ret->northwest = copy(subroot->northwest.get());
 	ret->northeast = copy(subroot->northeast.get());
 	ret->southwest = copy(subroot->southwest.get());
@@ -67,17 +87,67 @@ void quadtree::swap (quadtree &other)
 {
 	cout << "void quadtree::swap (quadtree &other)" << endl;
 	std::swap(other.root_, root_);
+	std::swap(other.width_, width_);
+	std::swap(other.height_, height_);
+	std::swap(other.orientation_, orientation_);
+	std::swap(other.thresholds_, thresholds_);
+	std::swap(other.kept_leaves_, kept_leaves_);
 }
 
-void quadtree::build_tree (const epng::png &source, uint64_t resolution)
+void quadtree::build_tree (const epng::png &source, uint64_t resolution, unsigned threads)
+{
+	build_region(source, resolution, resolution, threads);
+}
+
+void quadtree::build_tree (const epng::png &source, unsigned threads)
+{
+	build_region(source, source.width(), source.height(), threads);
+}
+
+void quadtree::build_tree (const epng::png &source)
+{
+	build_region(source, source.width(), source.height(), 0);
+}
+
+uint64_t quadtree::width () const
+{
+	return orientation_.shown_width(width_, height_);
+}
+
+uint64_t quadtree::height () const
+{
+	return orientation_.shown_height(width_, height_);
+}
+
+void quadtree::build_region (const epng::png &source, uint64_t width, uint64_t height, unsigned threads)
 {
-	epng::rgba_pixel elem;
 	root_ = nullptr;
+	width_ = 0;
+	height_ = 0;
+	orientation_ = orientation{};
+	build_thresholds();
+	if (width == 0 || height == 0)
+		return;
+
+	// the smallest power of two square that holds the image
+	uint64_t resolution = format::root_resolution(width, height);
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	// each parallel level multiplies the number of threads by four
+	int spawn_levels = 0;
+	for (uint64_t tasks = 1; tasks < threads; tasks *= 4)
+		spawn_levels++;
+
+	epng::rgba_pixel elem;
+	width_ = width;
+	height_ = height;
 	root_ = std::make_unique<node>(resolution, elem);
-	build_tree_recursive(source, resolution, root_.get(), 0, 0);
+	build_tree_recursive(source, resolution, root_.get(), 0, 0, spawn_levels);
+	build_thresholds();
 }
 
-void quadtree::build_tree_recursive (const epng::png &source, const uint64_t res_, node * subroot, const uint64_t x_, const uint64_t y_)
+void quadtree::build_tree_recursive (const epng::png &source, const uint64_t res_, node * subroot, const uint64_t x_, const uint64_t y_, int spawn_levels)
 {
 	
 	epng::rgba_pixel pix;
@@ -94,49 +164,73 @@ void quadtree::build_tree_recursive (const epng::png &source, const uint64_t res
 	// recursive calls
 	else {
 
-		subroot->northwest = std::make_unique<quadtree::node>(res_/2, pix);
-		subroot->northeast= std::make_unique<quadtree::node>(res_/2, pix);
-		subroot->southwest= std::make_unique<quadtree::node>(res_/2, pix);
-		subroot->southeast= std::make_unique<quadtree::node>(res_/2, pix);
-		build_tree_recursive(source, res_/2, subroot->northwest.get(), x_, y_);
-		build_tree_recursive(source, res_/2, subroot->northeast.get(), x_+res_/2, y_);
-		build_tree_recursive(source, res_/2, subroot->southwest.get(), x_, y_+res_/2);
-		build_tree_recursive(source, res_/2, subroot->southeast.get(), x_+res_/2, y_+res_/2);
+		uint64_t d = res_/2;
+		// quadrants lying entirely outside of the image are left out; the
+		// northwest one holds this node's own corner, so it is always there
+		bool east = x_+d < width_;
+		bool south = y_+d < height_;
+		subroot->northwest = std::make_unique<quadtree::node>(d, pix);
+		subroot->northeast = east ? std::make_unique<quadtree::node>(d, pix) : nullptr;
+		subroot->southwest = south ? std::make_unique<quadtree::node>(d, pix) : nullptr;
+		subroot->southeast = east && south ? std::make_unique<quadtree::node>(d, pix) : nullptr;
+
+		auto build_child = [&](node* child, uint64_t x, uint64_t y, int levels) {
+			if (child)
+				build_tree_recursive(source, d, child, x, y, levels);
+		};
+		if (spawn_levels > 0 && d >= parallel_cutoff_) {
+			// the quadrants share nothing: build three of them on other
+			// threads and the fourth on this one
+			auto ne = std::async(std::launch::async, [&]() {
+				build_child(subroot->northeast.get(), x_+d, y_, spawn_levels-1);
+			});
+			auto sw = std::async(std::launch::async, [&]() {
+				build_child(subroot->southwest.get(), x_, y_+d, spawn_levels-1);
+			});
+			auto se = std::async(std::launch::async, [&]() {
+				build_child(subroot->southeast.get(), x_+d, y_+d, spawn_levels-1);
+			});
+			build_child(subroot->northwest.get(), x_, y_, spawn_levels-1);
+			ne.get();
+			sw.get();
+			se.get();
+		} else {
+			build_child(subroot->northwest.get(), x_, y_, 0);
+			build_child(subroot->northeast.get(), x_+d, y_, 0);
+			build_child(subroot->southwest.get(), x_, y_+d, 0);
+			build_child(subroot->southeast.get(), x_+d, y_+d, 0);
+		}
 		subroot->res = res_;
 		average_children(subroot);
+
+		// the leaves are still exactly the pixels of this square (the part
+		// of it inside the image), so the tolerance can be measured against
+		// the source once, here
+		uint64_t x_end = std::min(x_+res_, width_);
+		uint64_t y_end = std::min(y_+res_, height_);
+		uint32_t tol = 0;
+		for (uint64_t j=y_; j<y_end; j++)
+			tol = std::max(tol, max_pixel_diff(source(x_, j), x_end - x_, subroot->element));
+		subroot->tol = tol;
 	}
 }
 
 void quadtree::average_children (node * subroot)
 {
 	
-	// either no child or 4
+	// either no child, or the northwest one and those of the others that
+	// lie inside the image
 	if (subroot->northwest) {
 		//cout << "average_children::has child" << endl;
-		epng::rgba_pixel ave;
-
-		//node * tmp = subroot->northwest.get();
-
-		//cout << "here" << endl;
-		ave.red = ( subroot->northwest->element.red
-				  + subroot->northeast->element.red
-				  + subroot->southwest->element.red
-				  + subroot->southeast->element.red ) /4;
-
-		ave.green = ( subroot->northwest->element.green
-				  + subroot->northeast->element.green 
-				  + subroot->southwest->element.green 
-				  + subroot->southeast->element.green ) /4;
-
-		ave.blue = ( subroot->northwest->element.blue 
-				  + subroot->northeast->element.blue 
-				  + subroot->southwest->element.blue 
-				  + subroot->southeast->element.blue ) /4;
-
-		ave.alpha = ( subroot->northwest->element.alpha 
-				  + subroot->northeast->element.alpha 
-				  + subroot->southwest->element.alpha 
-				  + subroot->southeast->element.alpha ) /4;
+		// there are 1, 2 or 4 children
+		epng::rgba_pixel ave = subroot->northwest->element;
+		node* ne = subroot->northeast.get();
+		node* sw = subroot->southwest.get();
+		node* se = subroot->southeast.get();
+		if (se)
+			ave = average_pixels(ave, ne->element, sw->element, se->element);
+		else if (ne || sw)
+			ave = average_pixels(ave, (ne ? ne : sw)->element);
 		
 		//cout << ave << endl;
 		subroot->element = ave;
@@ -148,7 +242,9 @@ const epng::rgba_pixel & quadtree::quadtree::operator() (uint64_t x, uint64_t y)
 {
 	//cout << "const epng::rgba_pixel & quadtree::quadtree::operator() (uint64_t x, uint64_t y) const" << endl;
 	if (!root_) throw std::runtime_error{"quadtree is empty"};
-	if ((x>=root_->res) || (y>=root_->res)) throw std::out_of_range{"(x,y) is out of range"};
+	if ((x>=width()) || (y>=height())) throw std::out_of_range{"(x,y) is out of range"};
+
+	orientation_.to_stored(x, y, width_, height_);
 
 	return get_pixel(root_.get(), x, y, root_->res, 0, 0);
 }
@@ -177,147 +273,296 @@ epng::png quadtree::decompress () const
 {
 	if (!root_) throw std::runtime_error{"empty tree"};
 
-	epng::png canvas(root_->res, root_->res);
-	paint(canvas, root_.get(), 0, 0, root_->res);	
+	epng::png canvas(width(), height());
+	paint(canvas, 0, 0, 0);
 
 	//cout << "returning canvas" << endl;
 	return canvas;
 }
 
-void quadtree::paint(epng::png& canvas_, node* subroot, uint64_t x_, uint64_t y_, uint64_t res_) const
+epng::png quadtree::render_region (uint64_t x0, uint64_t y0, uint64_t w, uint64_t h) const
 {
-	if (!subroot) return;
-	
-	for (uint64_t i=0; i<res_; i++) {
-		for (uint64_t j=0; j<res_; j++) {
-			*canvas_(i, j) = get_pixel(root_.get(), i, j, res_, 0, 0);
-		}
-	}
+	if (!root_) throw std::runtime_error{"empty tree"};
+	if (x0 > width() || w > width() - x0 || y0 > height() || h > height() - y0)
+		throw std::out_of_range{"region is out of range"};
+
+	epng::png canvas(w, h);
+	paint(canvas, x0, y0, 0);
+	return canvas;
 }
 
-void quadtree::rotate_children(node* subroot)
+epng::png quadtree::render_lod (unsigned level) const
 {
-	if (!subroot) return;
-	if (subroot->res == 1) return;
+	if (!root_) throw std::runtime_error{"empty tree"};
 
-	std::swap(subroot->northwest, subroot->northeast);
-	std::swap(subroot->southwest, subroot->southeast);
-	std::swap(subroot->northwest, subroot->southeast);
+	// the pixels of the output are the squares of the nodes at that level
+	int shift = 0;
+	while (level + shift < 64 && (uint64_t{1} << (level + shift)) < root_->res)
+		shift++;
+	uint64_t scale = uint64_t{1} << shift;
+	epng::png canvas((width() + scale - 1) >> shift, (height() + scale - 1) >> shift);
+	paint(canvas, 0, 0, shift);
+	return canvas;
+}
 
-	rotate_children(subroot->northwest.get());
-	rotate_children(subroot->northeast.get());
-	rotate_children(subroot->southwest.get());
-	rotate_children(subroot->southeast.get());
+void quadtree::paint(epng::png& canvas_, uint64_t x0, uint64_t y0, int shift) const
+{
+	// walk the tree once with an explicit stack. Each level pops one node
+	// and pushes its four children, so the stack never holds more than
+	// three nodes per level plus one, and a square has at most 64 levels.
+	// Squares are measured in output pixels, each 2^shift image pixels
+	// wide, and in the stored image: the region is turned into it, and
+	// each leaf's block back out of it as it is painted
+	struct square {
+		node* subroot;
+		uint64_t x;
+		uint64_t y;
+		uint64_t res;
+	};
+	std::array<square, 3 * 64 + 1> stack;
+	size_t top = 0;
+	stack[top++] = {root_.get(), 0, 0, std::max<uint64_t>(root_->res >> shift, 1)};
+
+	uint64_t scale = uint64_t{1} << shift;
+	uint64_t width = (width_ + scale - 1) >> shift;
+	uint64_t height = (height_ + scale - 1) >> shift;
+	orientation::rect region = orientation_.to_stored(
+			{x0, y0, x0 + canvas_.width(), y0 + canvas_.height()}, width, height);
+	while (top > 0) {
+		square sq = stack[--top];
+		// only the subtrees overlapping the region are visited
+		if (!sq.subroot || sq.x >= region.x1 || sq.y >= region.y1
+				|| sq.x + sq.res <= region.x0 || sq.y + sq.res <= region.y0)
+			continue;
+
+		// leaf, or a node as small as an output pixel, which holds the
+		// average of its leaves: fill the part of its square inside the
+		// region, a row at a time (the pixels of a row are contiguous)
+		if (!sq.subroot->northwest || sq.res == 1) {
+			orientation::rect block = orientation_.to_shown({
+					std::max(sq.x, region.x0), std::max(sq.y, region.y0),
+					std::min(sq.x + sq.res, region.x1), std::min(sq.y + sq.res, region.y1)},
+					width, height);
+			for (uint64_t j=block.y0; j<block.y1; j++)
+				std::fill_n(canvas_(block.x0 - x0, j - y0), block.x1 - block.x0, sq.subroot->element);
+			continue;
+		}
+
+		uint64_t d = sq.res/2;
+		stack[top++] = {sq.subroot->southeast.get(), sq.x+d, sq.y+d, d};
+		stack[top++] = {sq.subroot->southwest.get(), sq.x, sq.y+d, d};
+		stack[top++] = {sq.subroot->northeast.get(), sq.x+d, sq.y, d};
+		stack[top++] = {sq.subroot->northwest.get(), sq.x, sq.y, d};
+	}
 }
-	
+
 void quadtree::rotate_clockwise ()
 {
-	rotate_children(root_.get());
+	apply_transform(transform::rotate_90);
 }
 
-void quadtree::prune (uint32_t tolerance)
+void quadtree::apply_transform (transform t)
 {
-	prune_recursive(tolerance, root_.get());
+	// nothing is moved: the pixels are looked up through the new
+	// orientation from now on
+	orientation_ = orientation_.then(t);
 }
 
-void quadtree::prune_recursive (uint32_t tol_, node* subroot)
+void quadtree::prune (uint32_t tolerance)
 {
-	if (!(subroot->northwest)) return;
+	if (!root_) return;
+
+	// pruning replaces leaves, so the remaining nodes' cached tolerances
+	// have to be measured again against the new ones
+	if (prune_recursive(tolerance, root_.get())) {
+		std::vector<epng::rgba_pixel> leaves;
+		refresh_tolerance(root_.get(), leaves);
+		build_thresholds();
+	}
+}
 
-	uint32_t tol = get_tolerance(subroot, subroot);
+bool quadtree::prune_recursive (uint32_t tol_, node* subroot)
+{
+	if (!(subroot->northwest)) return false;
 
-	if (tol <= tol_) {
+	if (subroot->tol <= tol_) {
 		subroot->northwest = nullptr;
 		subroot->northeast = nullptr;
 		subroot->southwest = nullptr;
 		subroot->southeast = nullptr;
-		return;
+		subroot->tol = 0;
+		return true;
 	} else {
-		prune_recursive(tol_, subroot->northwest.get());
-		prune_recursive(tol_, subroot->northeast.get());
-		prune_recursive(tol_, subroot->southwest.get());
-		prune_recursive(tol_, subroot->southeast.get());
+		bool pruned = false;
+		for (node* child : {subroot->northwest.get(), subroot->northeast.get(),
+				subroot->southwest.get(), subroot->southeast.get()}) {
+			if (child && prune_recursive(tol_, child))
+				pruned = true;
+		}
+		return pruned;
 	}
 }
 
-uint32_t quadtree::get_tolerance (node* subroot, node* comp) const
+void quadtree::refresh_tolerance (node* subroot, std::vector<epng::rgba_pixel>& leaves)
 {
 	if (!(subroot->northwest)) {
-		return get_pix_diff(subroot->element, comp->element);
+		leaves.push_back(subroot->element);
+		return;
 	}
 
-	uint32_t nw, ne, sw, se;
-	nw = get_tolerance(subroot->northwest.get(), comp);
-	ne = get_tolerance(subroot->northeast.get(), comp);
-	sw = get_tolerance(subroot->southwest.get(), comp);
-	se = get_tolerance(subroot->southeast.get(), comp);
+	size_t first = leaves.size();
+	for (node* child : {subroot->northwest.get(), subroot->northeast.get(),
+			subroot->southwest.get(), subroot->southeast.get()}) {
+		if (child)
+			refresh_tolerance(child, leaves);
+	}
 
-	if (nw < ne) nw = ne;
-	if (nw < sw) nw = sw;
-	if (nw < se) nw = se;
-	return nw;
+	subroot->tol = max_pixel_diff(leaves.data() + first, leaves.size() - first, subroot->element);
+}
 
+uint64_t quadtree::pruned_size (uint32_t tolerance) const
+{
+	if (!root_) return 0;
 
+	// the internal nodes kept at this tolerance are those whose threshold
+	// is above it
+	size_t first = std::upper_bound(thresholds_.begin(), thresholds_.end(), tolerance)
+			- thresholds_.begin();
+	return 1 + kept_leaves_[first];
 }
 
-uint32_t quadtree::get_pix_diff (const epng::rgba_pixel& pix1, const epng::rgba_pixel& pix2) const
+uint32_t quadtree::ideal_prune (uint64_t num_leaves) const
 {
-	int a_red;
-	int a_green;
-	int a_blue;
-	a_red = (pix1.red - pix2.red);
-	a_green = (pix1.green - pix2.green);
-	a_blue = (pix1.blue - pix2.blue);
+	// the larger the tolerance, the fewer nodes are kept: find the first
+	// node that has to go for the kept ones to leave few enough leaves, and
+	// answer its threshold, the smallest tolerance that drops it
+	size_t first = std::partition_point(kept_leaves_.begin(), kept_leaves_.end(),
+			[num_leaves](uint64_t kept) { return 1 + kept > num_leaves; })
+			- kept_leaves_.begin();
+	// no tolerance leaves fewer than one leaf (none in an empty tree), so
+	// for num_leaves 0 answer the one that prunes the most
+	first = std::min(first, thresholds_.size());
+	if (first == 0)
+		return 0;
+	return thresholds_[first - 1];
+}
 
-	int ret = pow(a_red, 2) + pow(a_green, 2) + pow(a_blue, 2);
-	return ret;
+void quadtree::build_thresholds ()
+{
+	std::vector<std::pair<uint32_t, uint64_t>> thresholds;
+	if (root_)
+		collect_thresholds(root_.get(), std::numeric_limits<uint32_t>::max(), thresholds);
+	std::sort(thresholds.begin(), thresholds.end());
+
+	thresholds_.resize(thresholds.size());
+	kept_leaves_.assign(thresholds.size() + 1, 0);
+	for (size_t i=thresholds.size(); i-- > 0; ) {
+		thresholds_[i] = thresholds[i].first;
+		kept_leaves_[i] = kept_leaves_[i+1] + thresholds[i].second;
+	}
 }
 
-uint64_t quadtree::pruned_size (uint32_t tolerance) const
+void quadtree::collect_thresholds (node* subroot, uint32_t path_min, std::vector<std::pair<uint32_t, uint64_t>>& thresholds)
 {
-	uint64_t ret = pruned_size_recursive(tolerance, root_.get());
-	return ret;
+	if (!(subroot->northwest)) return;
+
+	std::array<node*, 4> children = {subroot->northwest.get(), subroot->northeast.get(),
+			subroot->southwest.get(), subroot->southeast.get()};
+	// keeping this node trades its one leaf for its children
+	uint64_t num_children = children.size()
+			- std::count(children.begin(), children.end(), nullptr);
+	path_min = std::min(path_min, subroot->tol);
+	thresholds.emplace_back(path_min, num_children - 1);
+	for (node* child : children) {
+		if (child)
+			collect_thresholds(child, path_min, thresholds);
+	}
 }
 
-uint64_t quadtree::pruned_size_recursive(uint32_t tol_, node* subroot) const
+void quadtree::serialize (std::ostream &out, bool delta) const
 {
-	if (!(subroot->northwest)) return 1;
+	format::write_header(out, {width_, height_, delta, orientation_});
+	if (!root_) return;
 
-	uint32_t tol = get_tolerance(subroot, subroot);
-	if (tol <= tol_)
-		return 1;
-	
-	uint64_t ret = pruned_size_recursive(tol_, subroot->northwest.get())
-					+ pruned_size_recursive(tol_, subroot->northeast.get())
-					+ pruned_size_recursive(tol_, subroot->southwest.get())
-					+ pruned_size_recursive(tol_, subroot->southeast.get());
-	return ret;
+	format::bit_writer bits{out};
+	format::color_coder colors{delta};
+	serialize_recursive(root_.get(), bits, colors);
+	bits.flush();
+}
 
+void quadtree::serialize_recursive (node* subroot, format::bit_writer& bits, format::color_coder& colors) const
+{
+	bool split = subroot->northwest != nullptr;
+	// a single pixel is always a leaf, so it needs no flag
+	if (subroot->res > 1)
+		bits.write(split, 1);
+	if (!split) {
+		colors.write(bits, subroot->element);
+		return;
+	}
+
+	for (node* child : {subroot->northwest.get(), subroot->northeast.get(),
+			subroot->southwest.get(), subroot->southeast.get()}) {
+		if (child)
+			serialize_recursive(child, bits, colors);
+	}
 }
 
-uint32_t quadtree::ideal_prune (uint64_t num_leaves) const
+void quadtree::deserialize (std::istream &in)
 {
-	// start with maximum tolerance and reduce it down by binary search
-	return find_tolerance(num_leaves, 0, 255*255*3);
+	root_ = nullptr;
+	width_ = 0;
+	height_ = 0;
+	orientation_ = orientation{};
+	build_thresholds();
+
+	format::header header = format::read_header(in);
+	if (header.width == 0)
+		return;
+
+	epng::rgba_pixel elem;
+	auto root = std::make_unique<node>(format::root_resolution(header.width, header.height), elem);
+	format::bit_reader bits{in};
+	format::color_coder colors{header.delta};
+	deserialize_recursive(root.get(), 0, 0, header.width, header.height, bits, colors);
+
+	root_ = std::move(root);
+	width_ = header.width;
+	height_ = header.height;
+	orientation_ = header.orient;
+	// every internal node is the average of its children, as it was when
+	// written, so only the cached tolerances have to be measured again
+	std::vector<epng::rgba_pixel> leaves;
+	refresh_tolerance(root_.get(), leaves);
+	build_thresholds();
 }
 
-uint32_t quadtree::find_tolerance(uint64_t num_leaves, uint32_t min, uint32_t max) const
+void quadtree::deserialize_recursive (node* subroot, uint64_t x_, uint64_t y_, uint64_t width, uint64_t height, format::bit_reader& bits, format::color_coder& colors)
 {
-	uint32_t d = (max+min)/2;
+	if (subroot->res == 1 || !bits.read(1)) {
+		subroot->element = colors.read(bits);
+		return;
+	}
 
-	if (pruned_size(d) > num_leaves) {
-		return find_tolerance(num_leaves, d, max);
+	epng::rgba_pixel pix;
+	uint64_t d = subroot->res/2;
+	bool east = x_+d < width;
+	bool south = y_+d < height;
+	subroot->northwest = std::make_unique<quadtree::node>(d, pix);
+	deserialize_recursive(subroot->northwest.get(), x_, y_, width, height, bits, colors);
+	if (east) {
+		subroot->northeast = std::make_unique<quadtree::node>(d, pix);
+		deserialize_recursive(subroot->northeast.get(), x_+d, y_, width, height, bits, colors);
 	}
-	else if (pruned_size(d) < num_leaves) {
-		return find_tolerance(num_leaves, min, d);
+	if (south) {
+		subroot->southwest = std::make_unique<quadtree::node>(d, pix);
+		deserialize_recursive(subroot->southwest.get(), x_, y_+d, width, height, bits, colors);
 	}
-	else {
-		while (pruned_size(d) == num_leaves) {
-			d--;
-		}
-		return d+1;
+	if (east && south) {
+		subroot->southeast = std::make_unique<quadtree::node>(d, pix);
+		deserialize_recursive(subroot->southeast.get(), x_+d, y_+d, width, height, bits, colors);
 	}
-
+	average_children(subroot);
 }
 
 }
@@ -9,11 +9,21 @@
 #define QUADTREE_H_
 
 #include <iostream>
+#include <utility>
+#include <vector>
 #include "epng.h"
+#include "orientation.h"
 
 namespace cs225
 {
 
+namespace format
+{
+class bit_writer;
+class bit_reader;
+class color_coder;
+}
+
 /**
  * A tree structure that is used to compress epng::png images.
  */
@@ -39,6 +49,13 @@ class quadtree
 	 * */
 
  	quadtree (const epng::png &source, uint64_t resolution);
+
+	/* Builds a quadtree representing the whole source image, whatever its
+	 * width and height.
+	 * Parameters
+	 * source	The source image to base this quadtree on
+	 * */
+ 	quadtree (const epng::png &source);
  
 	/* Copy constructor.Simply sets this quadtree to be a copy of the parameter.
 	 * Parameters
@@ -75,10 +92,27 @@ class quadtree
 
 /*Deletes the current contents of this quadtree object, then turns it into a quadtree object representing the upper-left d by d block of source.*/
 /*You may assume that d is a power of two, and that the width and height of source are each at least d.*/
+/*The quadrants of large squares are built on separate threads; the result is the same for any number of threads.*/
 /*Parameters*/
 /*source	The source image to base this quadtree on*/
 /*resolution	The width and height of the sides of the image to be represented*/
-void build_tree (const epng::png &source, uint64_t resolution);
+/*threads	The number of threads to build with (0 to use one per hardware thread, 1 to build serially)*/
+void build_tree (const epng::png &source, uint64_t resolution, unsigned threads = 0);
+
+/*Deletes the current contents of this quadtree object, then turns it into a quadtree object representing the whole of source.*/
+/*The image need not be square nor a power of two wide: the tree covers the smallest power of two square that holds it, and quadrants lying*/
+/*entirely outside of the image are left out, so a node may have fewer than four children (its northwest child is always there).*/
+/*Parameters*/
+/*source	The source image to base this quadtree on*/
+/*threads	The number of threads to build with (0 to use one per hardware thread, 1 to build serially)*/
+void build_tree (const epng::png &source, unsigned threads);
+void build_tree (const epng::png &source);
+
+/* Returns the width of the image the quadtree represents, as transformed (0 if it is empty). */
+	uint64_t width () const;
+
+/* Returns the height of the image the quadtree represents, as transformed (0 if it is empty). */
+	uint64_t height () const;
 
 	/* Gets the epng::rgba_pixel corresponding to the pixel at coordinates (x, y) 
 	 * in the image which the quadtree represents.	Note that the quadtree may not 
@@ -111,12 +145,39 @@ void build_tree (const epng::png &source, uint64_t resolution);
 	 * */
 		epng::png decompress () const;
 
+	/* Returns the w by h block of the image the quadtree represents whose
+	 * upper-left pixel is (x0, y0). Only the subtrees overlapping the block
+	 * are visited. Throws std::out_of_range if the block does not lie
+	 * within the image, and std::runtime_error if the quadtree is empty.
+	 * */
+	epng::png render_region (uint64_t x0, uint64_t y0, uint64_t w, uint64_t h) const;
+
+	/* Returns the image the quadtree represents, scaled down so that every
+	 * node level levels below the root becomes a single pixel of its
+	 * element (the average of its children); the tree is not walked any
+	 * deeper. The output is the image's size divided by the width of those
+	 * nodes, rounded up, so level 0 gives a single pixel and any level at
+	 * or below the bottom of the tree gives the full image. Throws
+	 * std::runtime_error if the quadtree is empty.
+	 * */
+	epng::png render_lod (unsigned level) const;
+
 	/* Rotates the quadtree object's underlying image clockwise by 90 degrees. 
-	 * (Note that this should be done using pointer manipulation, not by 
-	 * attempting to swap the element fields of nodes.
+	 * Same as apply_transform(transform::rotate_90).
 	 * */
 	void rotate_clockwise ();
 
+	/* Rotates or flips the image the quadtree represents, in constant time:
+	 * no node is touched. The tree keeps the orientation in which its image
+	 * is shown and every query and render reads the tree through it, so the
+	 * work is done as part of the next decompress. Transforms accumulate.
+	 * render_lod shows the reduced image of the tree as stored, transformed.
+	 *
+	 * Parameters
+	 * t	The rotation or flip to apply
+	 * */
+	void apply_transform (transform t);
+
 	/* Compresses the image this quadtree represents. If the color values 
 	 * of the leaves of a subquadtree don't vary by much, we might as well 
 	 * represent the entire subtree by, say, the average color value of 
@@ -182,10 +243,29 @@ void build_tree (const epng::png &source, uint64_t resolution);
  *
  * Returns 
  * The minimum tolerance needed to guarantee that there are no more than num_leaves remaining in the tree.
+ * If num_leaves is 0, which no tolerance achieves for a nonempty tree, the smallest tolerance that
+ * prunes the tree down to a single leaf; for an empty tree, 0.
  * Note The "obvious" implementation involves a sort of linear search over all possible tolerances. 
  * What if you tried a binary search instead?
  * */
  	uint32_t ideal_prune (uint64_t num_leaves) const;
+
+/* Writes the tree to out in the compact format described in quadtree_io.h: its leaves in
+ * preorder, each split flag a single bit. Pruning beforehand is what makes the output small.
+ *
+ * Parameters
+ * out	The stream to write to
+ * delta	Whether to code each leaf's color as its difference from the previous leaf's,
+ * 			which is much smaller for smooth images */
+	void serialize (std::ostream &out, bool delta = true) const;
+
+/* Deletes the current contents of this quadtree object, then turns it into the tree read from
+ * in, as written by serialize. Reads nothing past the end of the tree. Throws std::runtime_error
+ * if in does not hold a tree, and leaves this one empty.
+ *
+ * Parameters
+ * in	The stream to read from */
+	void deserialize (std::istream &in);
  
  	private:
     /**
@@ -208,6 +288,10 @@ void build_tree (const epng::png &source, uint64_t resolution);
 
         epng::rgba_pixel element; // the pixel stored as this node's "data"
 
+        // largest difference between element and any leaf below this node:
+        // the smallest tolerance at which this node would be pruned
+        uint32_t tol;
+
         // constructor
       	node(uint64_t res_, epng::rgba_pixel elem_) 
 		{ 
@@ -215,17 +299,47 @@ void build_tree (const epng::png &source, uint64_t resolution);
 			/*y = y_;*/
 			res = res_;
 			element = elem_;
+			tol = 0;
 		};
     };
 
     std::unique_ptr<node> root_; // the root of the tree
 
+	/* Size of the image the tree represents, as stored; the root's square
+	 * may be larger, in which case the parts of it outside the image are
+	 * left out */
+	uint64_t width_ = 0;
+	uint64_t height_ = 0;
+
+	/* How the stored image is shown: the rotations and flips applied to
+	 * it since it was built */
+	orientation orientation_;
+
+	/* The collapse threshold of every internal node, sorted: the smallest
+	 * tol on the path from the root down to it. A node is kept, with its
+	 * children, by exactly the prunes with a smaller tolerance. */
+	std::vector<uint32_t> thresholds_;
+
+	/* kept_leaves_[i] is how many leaves the nodes of thresholds_[i..]
+	 * add when they are kept (each turns one leaf into its children), so
+	 * pruning with tolerance t leaves 1 + kept_leaves_[i] leaves, where i
+	 * is the first threshold > t. It has one more entry than thresholds_. */
+	std::vector<uint64_t> kept_leaves_;
+
 	/*uint64_t size;*/
 
     /**
-     * recursive helper function for build_tree 
+     * recursive helper function for build_tree; the quadrants are built in
+     * parallel for spawn_levels more levels, as long as they are at least
+     * parallel_cutoff_ pixels wide
      */
-	void build_tree_recursive (const epng::png &source, const uint64_t resolution, node * subroot, const uint64_t x_, const uint64_t y_);
+	void build_tree_recursive (const epng::png &source, const uint64_t resolution, node * subroot, const uint64_t x_, const uint64_t y_, int spawn_levels);
+
+	/* Builds the tree of the upper-left width by height block of source. */
+	void build_region (const epng::png &source, uint64_t width, uint64_t height, unsigned threads);
+
+	/* Smallest quadrant worth building on its own thread */
+	const static uint64_t parallel_cutoff_ = 64;
 	/*auto build_tree_helper (const epng::png &source, const uint64_t res_) -> std::unique_ptr<node>;*/
 
 	void average_children (node * subroot);
@@ -234,22 +348,30 @@ void build_tree (const epng::png &source, uint64_t resolution);
 
 	epng::rgba_pixel& get_pixel(node * subroot, uint64_t x_, uint64_t y_, uint64_t res_, uint64_t x, uint64_t y) const;
 
-	void paint(epng::png& canvas_, node* subroot, uint64_t x_, uint64_t y_, uint64_t res_) const;
-
-	void rotate_children(node* subroot);
-	
-	uint32_t get_pix_diff(const epng::rgba_pixel& pix1, const epng::rgba_pixel& pix2) const;
+	/* Paints the part of the image, as shown, starting at (x0, y0) onto
+	 * canvas_, with the image scaled down by 2^shift: each node whose square
+	 * is that many pixels wide is painted as a single pixel of its color. */
+	void paint(epng::png& canvas_, uint64_t x0, uint64_t y0, int shift) const;
 
-	void prune_recursive(uint32_t tol_, node* subroot);
+	bool prune_recursive(uint32_t tol_, node* subroot);
 
-	/*uint32_t get_tolerance (node* subroot, node* child, node* ancestor) const;*/
-	uint32_t get_tolerance (node* subroot, node* comp) const;
+	/* Recomputes the cached tol of every internal node below subroot from
+	 * its current leaves, appending the colors of those leaves to leaves. */
+	void refresh_tolerance(node* subroot, std::vector<epng::rgba_pixel>& leaves);
 
 	/*bool get_tolerance (node* subroot, node* child, uint32_t tol) const;*/
 
-	uint64_t pruned_size_recursive(uint32_t tol_, node* subroot) const;
+	/* Rebuilds thresholds_ from the cached tol of every node. */
+	void build_thresholds();
+
+	/* Appends the threshold of every internal node below subroot, with the
+	 * number of leaves it adds, to thresholds. */
+	void collect_thresholds(node* subroot, uint32_t path_min, std::vector<std::pair<uint32_t, uint64_t>>& thresholds);
+
+	/* recursive helpers for serialize and deserialize */
+	void serialize_recursive(node* subroot, format::bit_writer& bits, format::color_coder& colors) const;
 
-	uint32_t find_tolerance(uint64_t num_leaves, uint32_t min, uint32_t max) const;
+	void deserialize_recursive(node* subroot, uint64_t x_, uint64_t y_, uint64_t width, uint64_t height, format::bit_reader& bits, format::color_coder& colors);
 
 /**** Do not remove this line or copy its contents here! ****/ 
 #include "quadtree_given.h" 
@@ -0,0 +1,195 @@
+/**
+ * @file quadtree_bench.cpp
+ * Benchmark of quadtree construction over image sizes.
+ *
+ * Usage: quadtree_bench [largest resolution] [iterations]
+ *
+ * It first checks ideal_prune at its edges (no leaves wanted, an empty
+ * tree).
+ *
+ * For each power of two resolution from 256 up to the largest, builds a
+ * quadtree of a synthetic image serially and with one thread per
+ * hardware thread, reports the best time of each and checks that both
+ * trees are identical.
+ *
+ * Then, on the largest image, compares the color arithmetic of the build
+ * with the floating point and channel by channel code it replaced: the
+ * tolerance scan (the largest difference from a color over every pixel)
+ * and the averaging of groups of four pixels.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+#include "pixel_math.h"
+#include "quadtree.h"
+
+using namespace std;
+using namespace cs225;
+
+namespace
+{
+/* A smooth gradient with some noise and hard edges, so that the tree
+ * prunes unevenly. */
+epng::png make_image (uint64_t res)
+{
+	epng::png image(res, res);
+	std::mt19937 rng{225};
+	for (uint64_t y=0; y<res; y++) {
+		for (uint64_t x=0; x<res; x++) {
+			epng::rgba_pixel* pixel = image(x, y);
+			pixel->red = (x * 255 / res + rng() % 8) % 256;
+			pixel->green = (y * 255 / res) % 256;
+			pixel->blue = ((x / 64 + y / 64) % 2) * 200 + rng() % 4;
+			pixel->alpha = 255;
+		}
+	}
+	return image;
+}
+
+/* Returns the best time, in milliseconds, of iterations calls to f. */
+template <class F>
+double best_time (int iterations, F f)
+{
+	double best = 0;
+	for (int i=0; i<iterations; i++) {
+		auto start = std::chrono::steady_clock::now();
+		f();
+		double ms = std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count();
+		best = (i == 0) ? ms : std::min(best, ms);
+	}
+	return best;
+}
+
+/* The color difference as it used to be computed, through double. */
+uint32_t pow_pixel_diff (const epng::rgba_pixel &pix1, const epng::rgba_pixel &pix2)
+{
+	int a_red = (pix1.red - pix2.red);
+	int a_green = (pix1.green - pix2.green);
+	int a_blue = (pix1.blue - pix2.blue);
+	int ret = pow(a_red, 2) + pow(a_green, 2) + pow(a_blue, 2);
+	return ret;
+}
+
+/* The average of four pixels as it used to be computed, a channel at a
+ * time. */
+epng::rgba_pixel channel_average (const epng::rgba_pixel *c)
+{
+	epng::rgba_pixel ave;
+	ave.red = (c[0].red + c[1].red + c[2].red + c[3].red) / 4;
+	ave.green = (c[0].green + c[1].green + c[2].green + c[3].green) / 4;
+	ave.blue = (c[0].blue + c[1].blue + c[2].blue + c[3].blue) / 4;
+	ave.alpha = (c[0].alpha + c[1].alpha + c[2].alpha + c[3].alpha) / 4;
+	return ave;
+}
+
+/* Times both versions of the color kernels over the pixels of image. */
+void bench_kernels (const epng::png &image, int iterations)
+{
+	std::vector<epng::rgba_pixel> pixels;
+	for (uint64_t y=0; y<image.height(); y++)
+		pixels.insert(pixels.end(), image(0, y), image(0, y) + image.width());
+	epng::rgba_pixel color = pixels[pixels.size() / 2];
+
+	uint32_t pow_max = 0;
+	uint32_t int_max = 0;
+	double pow_ms = best_time(iterations, [&]() {
+		pow_max = 0;
+		for (const auto &pixel : pixels)
+			pow_max = std::max(pow_max, pow_pixel_diff(pixel, color));
+	});
+	double int_ms = best_time(iterations, [&]() {
+		int_max = max_pixel_diff(pixels.data(), pixels.size(), color);
+	});
+	if (pow_max != int_max)
+		throw std::runtime_error{"tolerance scans differ"};
+
+	std::vector<epng::rgba_pixel> channel_out(pixels.size() / 4);
+	std::vector<epng::rgba_pixel> lane_out(pixels.size() / 4);
+	double channel_ms = best_time(iterations, [&]() {
+		for (size_t i=0; i<channel_out.size(); i++)
+			channel_out[i] = channel_average(&pixels[4*i]);
+	});
+	double lane_ms = best_time(iterations, [&]() {
+		for (size_t i=0; i<lane_out.size(); i++) {
+			const epng::rgba_pixel *c = &pixels[4*i];
+			lane_out[i] = average_pixels(c[0], c[1], c[2], c[3]);
+		}
+	});
+	if (!(channel_out == lane_out))
+		throw std::runtime_error{"averages differ"};
+
+	std::printf("\n%-16s %12s %12s %8s\n", "kernel", "old ms", "new ms", "speedup");
+	std::printf("%-16s %12.2f %12.2f %8.2f\n", "tolerance scan", pow_ms, int_ms, pow_ms / int_ms);
+	std::printf("%-16s %12.2f %12.2f %8.2f\n", "average of four", channel_ms, lane_ms, channel_ms / lane_ms);
+}
+
+/* Checks ideal_prune at its edges: asking for no leaves at all, and an
+ * empty tree. */
+void check_ideal_prune ()
+{
+	quadtree empty;
+	quadtree none(epng::png(), 0);
+	if (empty.ideal_prune(0) != 0 || empty.ideal_prune(5) != 0
+			|| none.ideal_prune(0) != 0 || none.pruned_size(none.ideal_prune(0)) != 0)
+		throw std::runtime_error{"ideal_prune of an empty tree is wrong"};
+
+	quadtree tree(make_image(64), 64);
+	uint32_t tol = tree.ideal_prune(0);
+	if (tree.pruned_size(tol) != 1 || (tol > 0 && tree.pruned_size(tol - 1) == 1))
+		throw std::runtime_error{"ideal_prune(0) does not prune to a single leaf"};
+	for (uint64_t n : {1, 2, 10, 100, 4096}) {
+		tol = tree.ideal_prune(n);
+		if (tree.pruned_size(tol) > n || (tol > 0 && tree.pruned_size(tol - 1) <= n))
+			throw std::runtime_error{"ideal_prune is not the smallest tolerance"};
+	}
+}
+
+/* Returns the best time, in milliseconds, to build a tree of image. */
+double time_build (const epng::png &image, uint64_t res, unsigned threads, int iterations, quadtree &tree)
+{
+	return best_time(iterations, [&]() { tree.build_tree(image, res, threads); });
+}
+}
+
+int main (int argc, char** argv)
+{
+	uint64_t max_res = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2048;
+	int iterations = argc > 2 ? std::atoi(argv[2]) : 3;
+	if (iterations < 1) {
+		std::fprintf(stderr, "usage: %s [largest resolution] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	// the report is printed with printf; silence the trace lines that
+	// quadtree's constructors and assignments write to cout
+	std::cout.setstate(std::ios::failbit);
+	check_ideal_prune();
+
+	std::printf("%10s %12s %12s %8s\n", "resolution", "serial ms", "parallel ms", "speedup");
+	uint64_t res=256;
+	for (; res<=max_res; res*=2) {
+		epng::png image = make_image(res);
+		quadtree serial;
+		quadtree parallel;
+		double serial_ms = time_build(image, res, 1, iterations, serial);
+		double parallel_ms = time_build(image, res, 0, iterations, parallel);
+
+		if (!(serial.decompress() == parallel.decompress())
+				|| serial.pruned_size(1000) != parallel.pruned_size(1000))
+			throw std::runtime_error{"parallel build differs from serial build"};
+
+		std::printf("%10llu %12.2f %12.2f %8.2f\n", (unsigned long long) res,
+				serial_ms, parallel_ms, serial_ms / parallel_ms);
+	}
+
+	bench_kernels(make_image(std::max<uint64_t>(res/2, 256)), iterations);
+	return 0;
+}
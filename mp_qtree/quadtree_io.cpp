@@ -0,0 +1,343 @@
+/**
+ * @file quadtree_io.cpp
+ * Implementation of the quadtree image format and its streaming decoder.
+ */
+
+#include "quadtree_io.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+namespace cs225
+{
+
+namespace format
+{
+namespace
+{
+const char magic[4] = {'Q', 'T', 'R', 'E'};
+
+/* The largest width or height a stream may declare; anything larger is
+ * taken to be corrupt rather than an image. */
+const uint64_t max_side = uint64_t{1} << 32;
+
+void write_u64 (std::ostream &out, uint64_t value)
+{
+	for (int i=0; i<8; i++)
+		out.put(static_cast<char>(value >> (8 * i)));
+}
+
+uint64_t read_u64 (std::istream &in)
+{
+	uint64_t value = 0;
+	for (int i=0; i<8; i++) {
+		int c = in.get();
+		if (c == std::char_traits<char>::eof())
+			throw std::runtime_error{"truncated quadtree header"};
+		value |= uint64_t(c) << (8 * i);
+	}
+	return value;
+}
+
+/* Maps small differences, of either sign, to small codes. */
+uint32_t zigzag (uint8_t difference)
+{
+	int8_t d = static_cast<int8_t>(difference);
+	return d >= 0 ? 2*d : -2*d - 1;
+}
+
+uint8_t unzigzag (uint32_t code)
+{
+	return static_cast<uint8_t>(code & 1 ? -int(code >> 1) - 1 : int(code >> 1));
+}
+
+void write_channel (bit_writer &bits, uint8_t previous, uint8_t value)
+{
+	uint32_t code = zigzag(value - previous);
+	if (code == 0) {
+		bits.write(0, 1);
+	} else if (code <= 8) {
+		bits.write(2, 2);
+		bits.write(code - 1, 3);
+	} else {
+		bits.write(3, 2);
+		bits.write(code, 8);
+	}
+}
+
+uint8_t read_channel (bit_reader &bits, uint8_t previous)
+{
+	uint32_t code = 0;
+	if (bits.read(1)) {
+		if (bits.read(1))
+			code = bits.read(8);
+		else
+			code = bits.read(3) + 1;
+	}
+	return previous + unzigzag(code);
+}
+}
+
+void write_header (std::ostream &out, const header &h)
+{
+	out.write(magic, sizeof(magic));
+	out.put(static_cast<char>((h.delta ? 1 : 0) | (h.orient.bits() << 1)));
+	write_u64(out, h.width);
+	write_u64(out, h.height);
+}
+
+header read_header (std::istream &in)
+{
+	char m[sizeof(magic)];
+	if (!in.read(m, sizeof(m)) || !std::equal(m, m + sizeof(m), magic))
+		throw std::runtime_error{"not a quadtree stream"};
+	int flags = in.get();
+	if (flags == std::char_traits<char>::eof() || (flags & ~0xf))
+		throw std::runtime_error{"bad quadtree header"};
+
+	header h;
+	h.delta = flags & 1;
+	h.orient = orientation::from_bits(flags >> 1);
+	h.width = read_u64(in);
+	h.height = read_u64(in);
+	if ((h.width == 0) != (h.height == 0) || h.width > max_side || h.height > max_side)
+		throw std::runtime_error{"bad quadtree header"};
+	return h;
+}
+
+uint64_t root_resolution (uint64_t width, uint64_t height)
+{
+	// stop at the largest power of two, which doubling would wrap to 0
+	const uint64_t largest = uint64_t{1} << 63;
+	uint64_t resolution = 1;
+	while (resolution < largest && (resolution < width || resolution < height))
+		resolution *= 2;
+	return resolution;
+}
+
+bit_writer::bit_writer (std::ostream &out) : out_(out), pending_{0}, num_pending_{0}
+{
+	// nothing
+}
+
+void bit_writer::write (uint32_t value, int count)
+{
+	for (int i=count-1; i>=0; i--) {
+		pending_ = (pending_ << 1) | ((value >> i) & 1);
+		if (++num_pending_ == 8) {
+			out_.put(static_cast<char>(pending_));
+			pending_ = 0;
+			num_pending_ = 0;
+		}
+	}
+}
+
+void bit_writer::flush ()
+{
+	if (num_pending_ > 0)
+		write(0, 8 - num_pending_);
+}
+
+bit_reader::bit_reader (std::istream &in) : in_(in), pending_{0}, num_pending_{0}
+{
+	// nothing
+}
+
+uint32_t bit_reader::read (int count)
+{
+	uint32_t value = 0;
+	for (int i=0; i<count; i++) {
+		if (num_pending_ == 0) {
+			int c = in_.get();
+			if (c == std::char_traits<char>::eof())
+				throw std::runtime_error{"truncated quadtree stream"};
+			pending_ = static_cast<uint32_t>(c);
+			num_pending_ = 8;
+		}
+		--num_pending_;
+		value = (value << 1) | ((pending_ >> num_pending_) & 1);
+	}
+	return value;
+}
+
+color_coder::color_coder (bool delta) : delta_{delta}
+{
+	// previous_ starts out as the default pixel, opaque white
+}
+
+void color_coder::write (bit_writer &bits, const epng::rgba_pixel &color)
+{
+	if (!delta_) {
+		bits.write(color.red, 8);
+		bits.write(color.green, 8);
+		bits.write(color.blue, 8);
+		bits.write(color.alpha, 8);
+		return;
+	}
+
+	if (color == previous_) {
+		bits.write(0, 1);
+		return;
+	}
+	bits.write(1, 1);
+	write_channel(bits, previous_.red, color.red);
+	write_channel(bits, previous_.green, color.green);
+	write_channel(bits, previous_.blue, color.blue);
+	write_channel(bits, previous_.alpha, color.alpha);
+	previous_ = color;
+}
+
+epng::rgba_pixel color_coder::read (bit_reader &bits)
+{
+	epng::rgba_pixel color;
+	if (!delta_) {
+		color.red = bits.read(8);
+		color.green = bits.read(8);
+		color.blue = bits.read(8);
+		color.alpha = bits.read(8);
+		return color;
+	}
+
+	if (bits.read(1)) {
+		previous_.red = read_channel(bits, previous_.red);
+		previous_.green = read_channel(bits, previous_.green);
+		previous_.blue = read_channel(bits, previous_.blue);
+		previous_.alpha = read_channel(bits, previous_.alpha);
+	}
+	return previous_;
+}
+}
+
+quadtree_reader::quadtree_reader (std::istream &in)
+	: header_(format::read_header(in)), bits_{in}, colors_{header_.delta}
+{
+	if (header_.width > 0)
+		pending_.push_back({0, 0, format::root_resolution(header_.width, header_.height)});
+}
+
+uint64_t quadtree_reader::width () const
+{
+	return header_.orient.shown_width(header_.width, header_.height);
+}
+
+uint64_t quadtree_reader::height () const
+{
+	return header_.orient.shown_height(header_.width, header_.height);
+}
+
+bool quadtree_reader::next (block &out)
+{
+	if (!next_stored(out))
+		return false;
+
+	orientation::rect r = header_.orient.to_shown({out.x, out.y, out.x + out.width, out.y + out.height},
+			header_.width, header_.height);
+	out.x = r.x0;
+	out.y = r.y0;
+	out.width = r.x1 - r.x0;
+	out.height = r.y1 - r.y0;
+	return true;
+}
+
+bool quadtree_reader::next_stored (block &out)
+{
+	while (!pending_.empty()) {
+		square sq = pending_.back();
+		pending_.pop_back();
+
+		if (sq.res > 1 && bits_.read(1)) {
+			// push the present children so that northwest comes out first
+			uint64_t d = sq.res/2;
+			bool east = sq.x+d < header_.width;
+			bool south = sq.y+d < header_.height;
+			if (east && south)
+				pending_.push_back({sq.x+d, sq.y+d, d});
+			if (south)
+				pending_.push_back({sq.x, sq.y+d, d});
+			if (east)
+				pending_.push_back({sq.x+d, sq.y, d});
+			pending_.push_back({sq.x, sq.y, d});
+			continue;
+		}
+
+		out.x = sq.x;
+		out.y = sq.y;
+		out.width = std::min(sq.res, header_.width - sq.x);
+		out.height = std::min(sq.res, header_.height - sq.y);
+		out.color = colors_.read(bits_);
+		return true;
+	}
+	return false;
+}
+
+void quadtree_reader::read_tiles (uint64_t tile_size,
+		const std::function<void(uint64_t x, uint64_t y, const epng::png &tile)> &on_tile)
+{
+	if (tile_size == 0 || (tile_size & (tile_size - 1)))
+		throw std::invalid_argument{"tile size must be a power of two"};
+
+	epng::png tile;
+	uint64_t tile_x = 0;
+	uint64_t tile_y = 0;
+	uint64_t missing = 0; // pixels of the current tile not painted yet
+
+	block b;
+	while (next_stored(b)) {
+		if (b.width >= tile_size || b.height >= tile_size) {
+			// the leaf covers whole tiles (its square is a multiple of
+			// the tile size): hand out each of them, in Z-order
+			uint64_t res = format::root_resolution(b.width, b.height);
+			std::vector<square> tiles{{b.x, b.y, res}};
+			while (!tiles.empty()) {
+				square sq = tiles.back();
+				tiles.pop_back();
+				if (sq.x >= header_.width || sq.y >= header_.height)
+					continue;
+				if (sq.res > tile_size) {
+					uint64_t d = sq.res/2;
+					tiles.push_back({sq.x+d, sq.y+d, d});
+					tiles.push_back({sq.x, sq.y+d, d});
+					tiles.push_back({sq.x+d, sq.y, d});
+					tiles.push_back({sq.x, sq.y, d});
+					continue;
+				}
+				uint64_t w = std::min(tile_size, header_.width - sq.x);
+				uint64_t h = std::min(tile_size, header_.height - sq.y);
+				epng::png filled(w, h);
+				for (uint64_t j=0; j<h; j++)
+					std::fill_n(filled(0, j), w, b.color);
+				emit_tile(sq.x, sq.y, filled, on_tile);
+			}
+			continue;
+		}
+
+		// a leaf smaller than a tile: paint it into the tile holding it
+		if (missing == 0) {
+			tile_x = b.x & ~(tile_size - 1);
+			tile_y = b.y & ~(tile_size - 1);
+			uint64_t w = std::min(tile_size, header_.width - tile_x);
+			uint64_t h = std::min(tile_size, header_.height - tile_y);
+			tile = epng::png(w, h);
+			missing = w * h;
+		}
+		for (uint64_t j=0; j<b.height; j++)
+			std::fill_n(tile(b.x - tile_x, b.y - tile_y + j), b.width, b.color);
+		missing -= b.width * b.height;
+		if (missing == 0)
+			emit_tile(tile_x, tile_y, tile, on_tile);
+	}
+}
+
+void quadtree_reader::emit_tile (uint64_t x, uint64_t y, const epng::png &tile,
+		const std::function<void(uint64_t x, uint64_t y, const epng::png &tile)> &on_tile) const
+{
+	if (header_.orient.identity()) {
+		on_tile(x, y, tile);
+		return;
+	}
+	orientation::rect r = header_.orient.to_shown({x, y, x + tile.width(), y + tile.height()},
+			header_.width, header_.height);
+	on_tile(r.x0, r.y0, header_.orient.apply(tile));
+}
+}
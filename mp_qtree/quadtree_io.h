@@ -0,0 +1,189 @@
+/**
+ * @file quadtree_io.h
+ * The on-disk quadtree image format, and a streaming decoder for it.
+ *
+ * A stream holds a header followed by a bitstream:
+ *
+ * 	"QTRE"	magic
+ * 	u8	flags: bit 0 set if leaf colors are delta coded; bits 1 to 3
+ * 		the orientation the image is shown in (orientation::bits)
+ * 	u64	width, little endian, at most 2^32
+ * 	u64	height, little endian, at most 2^32
+ *
+ * The width, height and tree are those of the image as stored, before
+ * the orientation is applied. The bitstream walks the tree in preorder
+ * (northwest, northeast, southwest, southeast), starting from the
+ * smallest power of two square that holds the image. Every node wider than a pixel starts with a split
+ * flag (1 if it has children); a leaf is then followed by its color.
+ * Quadrants lying entirely outside of the image are skipped, as they are
+ * in the tree. Bits are packed most significant first and the last byte
+ * is padded with zeros; an empty image has no bitstream.
+ *
+ * A raw color is 32 bits: red, green, blue, alpha. A delta coded color
+ * is a 0 bit if it is the same as the previous leaf's (opaque white for
+ * the first), else a 1 bit followed by the difference of each channel
+ * modulo 256, zigzag coded as 0 (for 0), 10 and 3 bits (for 1 to 8), or
+ * 11 and 8 bits.
+ */
+
+#ifndef QUADTREE_IO_H_
+#define QUADTREE_IO_H_
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include "epng.h"
+#include "orientation.h"
+
+namespace cs225
+{
+
+namespace format
+{
+/* The fields of a stream's header. */
+struct header
+{
+	uint64_t width;
+	uint64_t height;
+	bool delta;
+	orientation orient;
+};
+
+/* Writes header to out. */
+void write_header (std::ostream &out, const header &h);
+
+/* Reads a header from in. Throws std::runtime_error if in does not start
+ * with one, or if its width or height is out of range. */
+header read_header (std::istream &in);
+
+/* Returns the side of the root square of a width by height image: the
+ * smallest power of two at least as large as both, or 2^63 if there is
+ * none. */
+uint64_t root_resolution (uint64_t width, uint64_t height);
+
+/* Packs bits into the bytes of a stream, most significant first. */
+class bit_writer
+{
+  public:
+	explicit bit_writer (std::ostream &out);
+
+	/* Writes the low count bits of value (count at most 32). */
+	void write (uint32_t value, int count);
+
+	/* Writes out the pending bits, padding the last byte with zeros. */
+	void flush ();
+
+  private:
+	std::ostream &out_;
+	uint32_t pending_;
+	int num_pending_;
+};
+
+/* Reads bits written by a bit_writer, one byte of the stream at a time,
+ * so that nothing past the bitstream is consumed. */
+class bit_reader
+{
+  public:
+	explicit bit_reader (std::istream &in);
+
+	/* Reads count bits (at most 32). Throws std::runtime_error if the
+	 * stream ends first. */
+	uint32_t read (int count);
+
+  private:
+	std::istream &in_;
+	uint32_t pending_;
+	int num_pending_;
+};
+
+/* Codes the leaf colors of one stream, raw or as deltas from the
+ * previous leaf's. */
+class color_coder
+{
+  public:
+	explicit color_coder (bool delta);
+
+	void write (bit_writer &bits, const epng::rgba_pixel &color);
+
+	epng::rgba_pixel read (bit_reader &bits);
+
+  private:
+	bool delta_;
+	epng::rgba_pixel previous_;
+};
+}
+
+/**
+ * Decodes a stream written by quadtree::serialize without building the
+ * tree: the leaves come out one at a time in preorder, keeping only the
+ * squares still to be read (at most three per level), or gathered into
+ * tiles holding a single tile's pixels.
+ */
+class quadtree_reader
+{
+  public:
+	/* One leaf: a square of the image, clipped to its bounds, all of the
+	 * same color. Like everything the reader hands out, it is placed in
+	 * the image as shown. */
+	struct block
+	{
+		uint64_t x;
+		uint64_t y;
+		uint64_t width;
+		uint64_t height;
+		epng::rgba_pixel color;
+	};
+
+	/* Reads the header of the stream in, which must outlive the reader.
+	 * Throws std::runtime_error if in does not start with a header. */
+	explicit quadtree_reader (std::istream &in);
+
+	/* Returns the width of the image, as shown. */
+	uint64_t width () const;
+
+	/* Returns the height of the image, as shown. */
+	uint64_t height () const;
+
+	/* Reads the next leaf into out. Returns false once every leaf has
+	 * been read. Throws std::runtime_error if the stream is truncated.
+	 * */
+	bool next (block &out);
+
+	/* Reads every remaining leaf, handing the image to on_tile one tile at
+	 * a time: the tile_size by tile_size squares of the image (clipped at
+	 * its right and bottom edges), in Z-order. Since the leaves of a
+	 * square come one after another, only the tile being filled is held.
+	 * Must be called before next, and tile_size must be a power of two.
+	 * The tiles are those of the stored image, turned to the orientation
+	 * it is shown in, so a flipped image's tiles are aligned on its far
+	 * edge instead.
+	 * */
+	void read_tiles (uint64_t tile_size,
+			const std::function<void(uint64_t x, uint64_t y, const epng::png &tile)> &on_tile);
+
+  private:
+	struct square
+	{
+		uint64_t x;
+		uint64_t y;
+		uint64_t res;
+	};
+
+	/* Reads the next leaf like next, placed in the image as stored. */
+	bool next_stored (block &out);
+
+	/* Hands a tile of the stored image at (x, y) to on_tile, as shown. */
+	void emit_tile (uint64_t x, uint64_t y, const epng::png &tile,
+			const std::function<void(uint64_t x, uint64_t y, const epng::png &tile)> &on_tile) const;
+
+	format::header header_;
+	format::bit_reader bits_;
+	format::color_coder colors_;
+
+	/* The squares still to be read, the next one last */
+	std::vector<square> pending_;
+};
+}
+
+#endif